@@ -24,6 +24,9 @@
 #include <assert.h>
 #include <wdLib.h>
 #include <sysLib.h>
+#include <semLib.h>
+#include <tickLib.h>
+#include <taskLib.h>
 extern "C" {
 #include "callback.h"
 }
@@ -31,6 +34,8 @@ extern "C" {
 #include "epicsAssert.h"
 #include "epicsTime.h"
 #include "epicsTimer.h"
+#include "epicsMutex.h"
+#include "epicsThread.h"
 #include "iocsh.h"
 #endif
 
@@ -50,6 +55,15 @@ extern "C" {
 
 #define Z PRINTF_SIZE_T_PREFIX
 
+// handle write and read requests issued in the port thread directly
+int streamCombineRequests = 1;
+
+// trust the remembered EOS of a port instead of asking the driver
+int streamEosCache = 0;
+
+// flush old input before writes if no I/O Intr record uses the port
+int streamFlushInput = 0;
+
 /* How things are implemented:
 
 synchonous io:
@@ -110,8 +124,424 @@ initially. This calls intrCallbackOctet() every time input is received,
 but only if someone else is doing a read. Thus, if nobody reads
 something, arrange for periodical read polls.
 
+All "I/O Intr" clients of the same port and address with the same
+input terminator share one InputFramer. The first client which gets
+a chunk of input from intrCallbackOctet() splits it into complete
+messages. All clients (including the first) then get the same messages
+from framedReadHandler() without buffering and searching themselves.
+
 */
 
+class InputFramer
+{
+    static InputFramer* first;
+#ifdef EPICS_3_13
+    static SEM_ID mutex;
+    static void lock() { semTake(mutex, WAIT_FOREVER); }
+    static void unlock() { semGive(mutex); }
+#else
+    static epicsMutex mutex;
+    static void lock() { mutex.lock(); }
+    static void unlock() { mutex.unlock(); }
+#endif
+
+    struct Prefix
+    {
+        Prefix* next;
+        StreamBuffer text;
+        unsigned int users;
+        unsigned long generation; // changes when text changes
+    };
+
+    InputFramer* next;
+    StreamBuffer busname;
+    StreamBuffer terminator;
+    unsigned int users;
+    StreamBuffer buffer;   // unterminated input
+    Prefix* prefixes;      // constant prefixes of waiting in commands
+    int numPrefixes;
+    int numMatches;        // prefixes checked for each message
+    StreamBuffer matches;  // numMatches flags for each message
+    StreamBuffer generations; // generation of each checked prefix
+    unsigned long generation; // last prefix generation
+    double readTimeout;    // longest of all clients
+#ifdef EPICS_3_13
+    ULONG lastInput;
+#else
+    epicsTime lastInput;
+#endif
+public:
+    unsigned long chunk;   // number of last split input chunk
+    StreamBuffer messages; // ssize_t length + message, ...
+    unsigned long lines;      // messages split from input
+    unsigned long unmatched;  // messages without matching prefix
+    unsigned long dispatched; // messages passed to clients
+    unsigned long skipped;    // messages not passed because of prefix
+
+    static InputFramer* attach(const char* busname,
+        const char* terminator, size_t terminatorlen);
+    static void detach(InputFramer* framer);
+    bool hasTerminator(const char* terminator, size_t terminatorlen)
+        { return this->terminator.length() == terminatorlen &&
+            this->terminator.startswith(terminator, terminatorlen); }
+    void split(const char* data, size_t size,
+        const char* eos, size_t eoslen, bool end);
+    void setReadTimeout(double timeout);
+    void setPrefix(int& id, unsigned long& generation,
+        const char* prefix, size_t prefixlen);
+    bool prefixMatches(int id, unsigned long generation, int message);
+};
+
+InputFramer* InputFramer::first = NULL;
+#ifdef EPICS_3_13
+SEM_ID InputFramer::mutex = semMCreate(SEM_INVERSION_SAFE | SEM_Q_PRIORITY);
+#else
+epicsMutex InputFramer::mutex;
+#endif
+
+InputFramer* InputFramer::
+attach(const char* busname,
+    const char* terminator, size_t terminatorlen)
+{
+    InputFramer* framer;
+
+    lock();
+    for (framer = first; framer; framer = framer->next)
+    {
+        if (strcmp(framer->busname(), busname) == 0 &&
+            framer->hasTerminator(terminator, terminatorlen)) break;
+    }
+    if (!framer)
+    {
+        framer = new InputFramer;
+        framer->busname = busname;
+        framer->terminator.set(terminator, terminatorlen);
+        framer->users = 0;
+        framer->prefixes = NULL;
+        framer->numPrefixes = 0;
+        framer->numMatches = 0;
+        framer->generation = 0;
+        framer->chunk = 0;
+        framer->readTimeout = 0.0;
+        framer->lines = 0;
+        framer->unmatched = 0;
+        framer->dispatched = 0;
+        framer->skipped = 0;
+        framer->next = first;
+        first = framer;
+    }
+    framer->users++;
+    unlock();
+    return framer;
+}
+
+void InputFramer::
+detach(InputFramer* framer)
+{
+    InputFramer** pframer;
+
+    lock();
+    if (--framer->users == 0)
+    {
+        for (pframer = &first; *pframer; pframer = &(*pframer)->next)
+        {
+            if (*pframer == framer)
+            {
+                *pframer = framer->next;
+                break;
+            }
+        }
+        while (framer->prefixes)
+        {
+            Prefix* prefix = framer->prefixes;
+            framer->prefixes = prefix->next;
+            delete prefix;
+        }
+        delete framer;
+    }
+    unlock();
+}
+
+void InputFramer::
+setReadTimeout(double timeout)
+{
+    // keep incomplete input as long as any client would
+    lock();
+    if (readTimeout < timeout)
+        readTimeout = timeout;
+    unlock();
+}
+
+void InputFramer::
+setPrefix(int& id, unsigned long& gen, const char* text, size_t textlen)
+{
+    // Clients share one entry for the same prefix.
+    // Entries keep their id (position) for the lifetime of the framer.
+    // Unused entries get new text and a new generation, because
+    // messages may still be dispatched with flags for the old text.
+    Prefix* prefix;
+    Prefix** pprefix;
+    int i;
+
+    lock();
+    for (i = 0, prefix = prefixes; prefix; i++, prefix = prefix->next)
+    {
+        if (i == id)
+        {
+            if (prefix->text.length() == textlen &&
+                prefix->text.startswith(text, textlen))
+            {
+                // unchanged
+                unlock();
+                return;
+            }
+            prefix->users--;
+            break;
+        }
+    }
+    id = -1;
+    if (textlen)
+    {
+        Prefix* unused = NULL;
+        int unusedId = -1;
+        for (i = 0, pprefix = &prefixes; *pprefix;
+            i++, pprefix = &(*pprefix)->next)
+        {
+            prefix = *pprefix;
+            if (prefix->text.length() == textlen &&
+                prefix->text.startswith(text, textlen)) break;
+            if (!unused && !prefix->users)
+            {
+                unused = prefix;
+                unusedId = i;
+            }
+        }
+        if (!*pprefix)
+        {
+            if (unused)
+            {
+                prefix = unused;
+                i = unusedId;
+            }
+            else
+            {
+                prefix = new Prefix;
+                prefix->next = NULL;
+                prefix->users = 0;
+                *pprefix = prefix;
+                numPrefixes++;
+            }
+            prefix->text.set(text, textlen);
+            prefix->generation = ++generation;
+        }
+        prefix->users++;
+        id = i;
+        gen = prefix->generation;
+    }
+    unlock();
+}
+
+bool InputFramer::
+prefixMatches(int id, unsigned long gen, int message)
+{
+    // Port thread only, like split().
+    // Without flags for this prefix (added or changed after the
+    // split) let the client check the message itself.
+    if (id < 0 || id >= numMatches) return true;
+    unsigned long checked;
+    memcpy(&checked, generations(id * sizeof(checked)), sizeof(checked));
+    if (checked != gen) return true;
+    return matches[message * numMatches + id];
+}
+
+void InputFramer::
+split(const char* data, size_t size,
+    const char* eos, size_t eoslen, bool end)
+{
+    // Called in port thread context only, thus no locking
+    // except for the prefixes and the read timeout.
+    // Messages keep their terminators, thus clients can
+    // still handle input which arrives before their "in" command.
+    size_t termlen = terminator.length();
+    ssize_t start, pos, len;
+    const char* message;
+    Prefix* prefix;
+    int i;
+
+    lock();
+    double timeout = readTimeout;
+    unlock();
+#ifdef EPICS_3_13
+    ULONG now = tickGet();
+    if (buffer && (now - lastInput) > timeout * sysClkRateGet())
+#else
+    epicsTime now = epicsTime::getCurrent();
+    if (buffer && now - lastInput > timeout)
+#endif
+    {
+        // like a read timeout: drop incomplete message
+        debug("InputFramer::split(%s) dropping incomplete input \"%s\"\n",
+            busname(), buffer.expand()());
+        buffer.clear();
+    }
+    lastInput = now;
+    messages.clear();
+    chunk++;
+
+    // beware of split terminators
+    start = buffer.length() - termlen + 1;
+    if (start < 0) start = 0;
+    buffer.append(data, size);
+    buffer.append(eos, eoslen);
+    pos = 0;
+    while ((start = buffer.find(terminator, start)) >= 0)
+    {
+        start += termlen;
+        len = start - pos;
+        messages.append(&len, sizeof(len));
+        messages.append(buffer(pos), len);
+        pos = start;
+    }
+    if (end && pos < (ssize_t)buffer.length())
+    {
+        // no terminator but end flag
+        len = buffer.length() - pos;
+        messages.append(&len, sizeof(len));
+        messages.append(buffer(pos), len);
+        pos += len;
+    }
+    buffer.remove(pos);
+
+    // Check each message once against all prefixes.
+    // Clients then only look up their flag.
+    matches.clear();
+    generations.clear();
+    lock();
+    numMatches = numPrefixes;
+    bool waiting = false;
+    for (prefix = prefixes; prefix; prefix = prefix->next)
+    {
+        if (prefix->users) waiting = true;
+        generations.append(&prefix->generation, sizeof(prefix->generation));
+    }
+    for (message = messages(); message < messages.end(); message += len)
+    {
+        bool found = false;
+        memcpy(&len, message, sizeof(len));
+        message += sizeof(len);
+        for (i = 0, prefix = prefixes; prefix; i++, prefix = prefix->next)
+        {
+            bool match = prefix->users &&
+                (size_t)len >= prefix->text.length() &&
+                memcmp(message, prefix->text(), prefix->text.length()) == 0;
+            matches.append((char)match);
+            found |= match;
+        }
+        lines++;
+        if (waiting && !found) unmatched++;
+    }
+    unlock();
+}
+
+// State shared by all clients of one asyn port (and address if the
+// port has separate EOS per address).
+// The input and output EOS currently installed in the asyn driver
+// are only used in port thread context. They are invalidated by
+// exceptions, e.g. a reconnect or streamReinit.
+
+class PortState
+{
+    static PortState* first;
+#ifdef EPICS_3_13
+    static SEM_ID mutex;
+    static void lock() { semTake(mutex, WAIT_FOREVER); }
+    static void unlock() { semGive(mutex); }
+#else
+    static epicsMutex mutex;
+    static void lock() { mutex.lock(); }
+    static void unlock() { mutex.unlock(); }
+#endif
+
+    PortState* next;
+    StreamBuffer busname;
+    unsigned int users;
+public:
+    bool inputValid;
+    bool outputValid;
+    StreamBuffer inputEos;
+    StreamBuffer outputEos;
+    unsigned long calls;   // EOS get/set calls to the driver
+    unsigned long skipped; // EOS get/set calls avoided
+    unsigned int intrUsers; // clients registered for I/O Intr (locked)
+    unsigned long drained; // bytes discarded before writes
+    unsigned long flushes; // flushes instead of draining
+
+    static PortState* attach(const char* busname);
+    static void detach(PortState* cache);
+    void invalidate() { inputValid = outputValid = false; }
+    void addIntrUser() { lock(); intrUsers++; unlock(); }
+    void removeIntrUser() { lock(); intrUsers--; unlock(); }
+    bool hasIntrUsers()
+        { lock(); bool users = intrUsers != 0; unlock(); return users; }
+};
+
+PortState* PortState::first = NULL;
+#ifdef EPICS_3_13
+SEM_ID PortState::mutex = semMCreate(SEM_INVERSION_SAFE | SEM_Q_PRIORITY);
+#else
+epicsMutex PortState::mutex;
+#endif
+
+PortState* PortState::
+attach(const char* busname)
+{
+    PortState* cache;
+
+    lock();
+    for (cache = first; cache; cache = cache->next)
+    {
+        if (strcmp(cache->busname(), busname) == 0) break;
+    }
+    if (!cache)
+    {
+        cache = new PortState;
+        cache->busname = busname;
+        cache->users = 0;
+        cache->invalidate();
+        cache->calls = 0;
+        cache->skipped = 0;
+        cache->intrUsers = 0;
+        cache->drained = 0;
+        cache->flushes = 0;
+        cache->next = first;
+        first = cache;
+    }
+    cache->users++;
+    unlock();
+    return cache;
+}
+
+void PortState::
+detach(PortState* cache)
+{
+    PortState** pcache;
+
+    lock();
+    if (--cache->users == 0)
+    {
+        for (pcache = &first; *pcache; pcache = &(*pcache)->next)
+        {
+            if (*pcache == cache)
+            {
+                *pcache = cache->next;
+                break;
+            }
+        }
+        delete cache;
+    }
+    unlock();
+}
+
 class AsynDriverInterface : StreamBusInterface
 #ifndef EPICS_3_13
  , epicsTimerNotify
@@ -166,12 +596,31 @@ class AsynDriverInterface : StreamBusInterface
     double readTimeout;
     double replyTimeout;
     ssize_t expectedLength;
+    bool inHandleRequest;
+#ifdef EPICS_3_13
+    int handlerThread;
+#else
+    epicsThreadId handlerThread;
+#endif
+    bool requestPending;
     unsigned long eventMask;
     unsigned long receivedEvent;
     StreamBuffer inputBuffer;
+    PortState* portState;
+    InputFramer* framer;
+    unsigned long framerChunk;
+    int framerPrefix;
+    unsigned long framerGeneration;
     const char* outputBuffer;
     size_t outputSize;
     size_t peeksize;
+    // shortest reply seen for each in command
+    enum { LearnedReplies = 8 };
+    struct { const void* command; size_t length; } learned[LearnedReplies];
+    int numLearned;
+    size_t shortestReply;     // of the current in command
+    const char* readStrategy;
+    size_t firstReadSize;
 #ifdef EPICS_3_13
     WDOG_ID timer;
     CALLBACK timeoutCallback;
@@ -197,6 +646,7 @@ class AsynDriverInterface : StreamBusInterface
     bool connectRequest(unsigned long connecttimeout_ms);
     bool disconnectRequest();
     void finish();
+    void printStatus(StreamBuffer& buffer);
 
 #ifdef EPICS_3_13
     static void expire(CALLBACK *pcallback);
@@ -211,10 +661,30 @@ class AsynDriverInterface : StreamBusInterface
     void lockHandler();
     void writeHandler();
     void readHandler();
+    size_t learnedReply(const void* command);
+    void rememberReply(const void* command, size_t length);
     void connectHandler();
     void disconnectHandler();
     bool connectToAsynPort();
     void asynReadHandler(const char *data, size_t numchars, int eomReason);
+    void framedReadHandler(const char *data, size_t numchars, int eomReason);
+    asynStatus getInputEos(char* eos, int size, int* eoslen);
+    asynStatus setInputEos(const char* eos, int eoslen);
+    asynStatus getOutputEos(char* eos, int size, int* eoslen);
+    asynStatus setOutputEos(const char* eos, int eoslen);
+    bool handleNow() {
+        // Request from inside our own handleRequest(): we have the port,
+        // thus handle it there right after the current handler.
+        // Requests from other threads meanwhile must be queued.
+        if (!inHandleRequest || !streamCombineRequests) return false;
+#ifdef EPICS_3_13
+        if (handlerThread != taskIdSelf()) return false;
+#else
+        if (handlerThread != epicsThreadGetIdSelf()) return false;
+#endif
+        requestPending = true;
+        return true;
+    }
     asynQueuePriority priority() {
         return static_cast<asynQueuePriority>
             (StreamBusInterface::priority());
@@ -288,15 +758,27 @@ AsynDriverInterface(Client* client) : StreamBusInterface(client)
     pasynCommon = NULL;
     pasynOctet = NULL;
     intrPvtOctet = NULL;
+    portState = NULL;
+    framer = NULL;
+    framerChunk = 0;
+    framerPrefix = -1;
+    framerGeneration = 0;
     pasynInt32 = NULL;
     intrPvtInt32 = NULL;
     pasynUInt32 = NULL;
     intrPvtUInt32 = NULL;
     pasynGpib = NULL;
     connected = 0;
+    inHandleRequest = false;
+    handlerThread = 0;
+    requestPending = false;
     eventMask = 0;
     receivedEvent = 0;
     peeksize = 1;
+    numLearned = 0;
+    shortestReply = 0;
+    readStrategy = NULL;
+    firstReadSize = 0;
     previousAsynStatus = asynSuccess;
     debug ("AsynDriverInterface(%s) createAsynUser\n", client->name());
     pasynUser = pasynManager->createAsynUser(handleRequest,
@@ -345,6 +827,16 @@ AsynDriverInterface::
         {
             pasynOctet->cancelInterruptUser(pvtOctet,
                 pasynUser, intrPvtOctet);
+            portState->removeIntrUser();
+        }
+        if (framer)
+        {
+            framer->setPrefix(framerPrefix, framerGeneration, NULL, 0);
+            InputFramer::detach(framer);
+        }
+        if (portState)
+        {
+            PortState::detach(portState);
         }
         pasynManager->cancelRequest(pasynUser, &wasQueued);
         // does not return until running handler has finished
@@ -433,6 +925,23 @@ supportsEvent()
 bool AsynDriverInterface::
 supportsAsyncRead()
 {
+    // share input framing with other clients using the same terminator
+    // (the protocol and thus the terminator may have changed)
+    size_t streameoslen;
+    const char* streameos = getInTerminator(streameoslen);
+    if (framer && !(streameos && streameoslen &&
+        framer->hasTerminator(streameos, streameoslen)))
+    {
+        framer->setPrefix(framerPrefix, framerGeneration, NULL, 0);
+        InputFramer::detach(framer);
+        framer = NULL;
+    }
+    if (!framer && streameos && streameoslen)
+    {
+        framer = InputFramer::attach(name(), streameos, streameoslen);
+        framerChunk = framer->chunk;
+    }
+
     if (intrPvtOctet) return true;
 
     // hook "I/O Intr" support
@@ -443,6 +952,7 @@ supportsAsyncRead()
             clientName(), name(), pasynUser->errorMessage);
         return false;
     }
+    portState->addIntrUser();
     return true;
 }
 
@@ -486,6 +996,14 @@ connectToBus(const char* portname, int addr)
     pasynOctet = static_cast<asynOctet*>(pasynInterface->pinterface);
     pvtOctet = pasynInterface->drvPvt;
 
+    // All clients of a port share the knowledge of its EOS,
+    // unless the port has separate EOS per address.
+    int multiDevice = 0;
+    pasynManager->isMultiDevice(pasynUser, portname, &multiDevice);
+    StreamBuffer eosKey(portname);
+    if (multiDevice) eosKey.print(" %d", addr);
+    portState = PortState::attach(eosKey());
+
     // Check if device knows EOS
     size_t streameoslen = 0;
     if (getInTerminator(streameoslen))
@@ -635,6 +1153,13 @@ writeRequest(const void* output, size_t size,
     outputSize = size;
     writeTimeout = writeTimeout_ms*0.001;
     ioAction = Write;
+    if (handleNow())
+    {
+        debug("AsynDriverInterface::writeRequest %s: "
+            "handle without queueRequest()\n",
+            clientName());
+        return true;
+    }
     status = pasynManager->queueRequest(pasynUser, priority(),
         writeTimeout);
     reportAsynStatus(status, "writeRequest");
@@ -654,33 +1179,47 @@ writeHandler()
     size_t written = 0;
 
     pasynUser->timeout = 0;
-    if (!pasynGpib)
+    if (!pasynGpib && (!streamFlushInput || portState->hasIntrUsers()))
     {
         // discard any early input, but forward it to potential async records
-        // thus do not use pasynOctet->flush()
+        // (ours or other asyn interrupt users) thus do not use flush()
         // unfortunately we cannot do this with GPIB because addressing a
         // device as talker when it has nothing to say is an error.
         // Also timeout=0 does not help here (would need a change in asynGPIB),
         // thus use flush() for GPIB.
+        // Read into the (large) input buffer to need few reads for bursts.
+        size_t drained = 0;
+        size_t buffersize = inputBuffer.capacity();
+        if (buffersize < 4096) buffersize = 4096;
+        char* buffer = inputBuffer.clear().reserve(buffersize);
         do {
-            char buffer [256];
             size_t received = 0;
             int eomReason = 0;
             debug("AsynDriverInterface::writeHandler(%s): reading old input\n",
                 clientName());
             status = pasynOctet->read(pvtOctet, pasynUser,
-                buffer, sizeof(buffer), &received, &eomReason);
+                buffer, buffersize, &received, &eomReason);
             if (status == asynError || received == 0) break;
-            if (received) debug("AsynDriverInterface::writeHandler(%s): "
+            debug("AsynDriverInterface::writeHandler(%s): "
                 "flushing %" Z "u bytes: \"%s\"\n",
                 clientName(), received, StreamBuffer(buffer, received).expand()());
+            drained += received;
         } while (status == asynSuccess);
+        if (drained)
+        {
+            debug("AsynDriverInterface::writeHandler(%s): "
+                "discarded %" Z "u bytes of old input\n",
+                clientName(), drained);
+            portState->drained += drained;
+        }
     }
     else
     {
+        // GPIB or no I/O Intr records and flushing allowed
         debug("AsynDriverInterface::writeHandler(%s): flushing old input\n",
             clientName());
-         pasynOctet->flush(pvtOctet, pasynUser);
+        pasynOctet->flush(pvtOctet, pasynUser);
+        portState->flushes++;
     }
 
     // discard any early events
@@ -698,15 +1237,13 @@ writeHandler()
     if (streameos) // stream has already added eos, don't do it again in asyn
     {
         // clear terminator for asyn
-        status = pasynOctet->getOutputEos(pvtOctet,
-            pasynUser, oldeos, sizeof(oldeos)-1, &oldeoslen);
+        status = getOutputEos(oldeos, sizeof(oldeos)-1, &oldeoslen);
         if (status != asynSuccess)
         {
             oldeoslen = -1;
             // No EOS support?
         }
-        pasynOctet->setOutputEos(pvtOctet, pasynUser,
-            NULL, 0);
+        setOutputEos(NULL, 0);
     }
     int writeTry = 0;
     do {
@@ -731,8 +1268,7 @@ writeHandler()
 
     if (oldeoslen >= 0) // restore asyn terminator
     {
-        pasynOctet->setOutputEos(pvtOctet, pasynUser,
-            oldeos, oldeoslen);
+        setOutputEos(oldeos, oldeoslen);
     }
 
     switch (status)
@@ -820,6 +1356,15 @@ readRequest(unsigned long replyTimeout_ms, unsigned long readTimeout_ms,
     {
         ioAction = AsyncRead;
         queueTimeout = -1.0;
+        if (framer)
+        {
+            framer->setReadTimeout(readTimeout);
+            // only get messages which start like the in command
+            size_t prefixlen;
+            const char* prefix = getInPrefix(prefixlen);
+            framer->setPrefix(framerPrefix, framerGeneration,
+                prefix, prefixlen);
+        }
         // First poll for input (no timeout),
         // later poll periodically if no other input arrives
         // from intrCallbackOctet()
@@ -827,6 +1372,13 @@ readRequest(unsigned long replyTimeout_ms, unsigned long readTimeout_ms,
     else {
         ioAction = Read;
         queueTimeout = replyTimeout;
+        if (handleNow())
+        {
+            debug("AsynDriverInterface::readRequest %s: "
+                "handle without queueRequest()\n",
+                clientName());
+            return true;
+        }
     }
     status = pasynManager->queueRequest(pasynUser,
         priority(), queueTimeout);
@@ -856,6 +1408,36 @@ readRequest(unsigned long replyTimeout_ms, unsigned long readTimeout_ms,
     return true;
 }
 
+// shortest reply of an in command so far, 0 if unknown
+size_t AsynDriverInterface::
+learnedReply(const void* command)
+{
+    int i;
+
+    if (!command) return 0;
+    for (i = 0; i < numLearned; i++)
+        if (learned[i].command == command) return learned[i].length;
+    return 0;
+}
+
+void AsynDriverInterface::
+rememberReply(const void* command, size_t length)
+{
+    int i;
+
+    if (!command) return;
+    for (i = 0; i < numLearned; i++)
+        if (learned[i].command == command) break;
+    if (i == numLearned)
+    {
+        // protocols with more in commands peek for the others
+        if (numLearned == LearnedReplies) return;
+        learned[numLearned++].command = command;
+    }
+    learned[i].length = length;
+    shortestReply = length;
+}
+
 // now, we can read (called by asynManager)
 void AsynDriverInterface::
 readHandler()
@@ -866,6 +1448,8 @@ readHandler()
     int oldeoslen = -1;
     char oldeos[16];
 
+    bool eosInstalled = false;
+
     // Setup eos if required.
     streameos = getInTerminator(streameoslen);
     deveos = streameos;
@@ -873,8 +1457,7 @@ readHandler()
     if (streameos) // streameos == NULL means: don't change eos
     {
         asynStatus status;
-        status = pasynOctet->getInputEos(pvtOctet,
-            pasynUser, oldeos, sizeof(oldeos)-1, &oldeoslen);
+        status = getInputEos(oldeos, sizeof(oldeos)-1, &oldeoslen);
         if (status != asynSuccess)
             oldeoslen = -1;
         else do {
@@ -882,11 +1465,12 @@ readHandler()
             if (deveoslen == (size_t)oldeoslen && strcmp(deveos, oldeos) == 0)
             {
                 // nothing to do: old and new eos are the same
+                eosInstalled = true;
                 break;
             }
-            if (pasynOctet->setInputEos(pvtOctet, pasynUser,
-                deveos, (int)deveoslen) == asynSuccess)
+            if (setInputEos(deveos, (int)deveoslen) == asynSuccess)
             {
+                eosInstalled = true;
                 if (ioAction != AsyncRead)
                 {
                     debug("AsynDriverInterface::readHandler(%s) "
@@ -912,17 +1496,13 @@ readHandler()
     if (expectedLength > 0)
     {
         buffersize = expectedLength;
-        if (peeksize > 1)
-        {
-            /* we can't peek, try to read whole message */
-            bytesToRead = expectedLength;
-        }
     }
     else
     {
         buffersize = inputBuffer.capacity();
     }
     char* buffer = inputBuffer.clear().reserve(buffersize);
+    const void* replyCommand = NULL;
 
     if (ioAction == AsyncRead)
     {
@@ -934,7 +1514,52 @@ readHandler()
     else
     {
         pasynUser->timeout = replyTimeout;
+
+        // Peeking only 1 byte makes sure that replyTimeout is only
+        // used for the first byte. Read more if that is safe:
+        // Shorter replies cannot match the protocol and this in
+        // command has never got shorter replies before.
+        // The rest is read with readTimeout.
+        bool pseudo;
+        size_t minLength = getInMinLength(pseudo);
+        replyCommand = getInCommand();
+        shortestReply = learnedReply(replyCommand);
+        size_t safeLength = minLength;
+        if (safeLength < shortestReply) safeLength = shortestReply;
+        if (expectedLength > 0)
+        {
+            // known length (maxInput): never more than that
+            readStrategy = "exact";
+            bytesToRead = expectedLength;
+            if (safeLength && safeLength < bytesToRead)
+                bytesToRead = safeLength;
+        }
+        else if (peeksize > 1)
+        {
+            // we can't peek, try to read whole message
+            readStrategy = "no peek";
+            bytesToRead = buffersize;
+        }
+        else if (eosInstalled && deveoslen == streameoslen)
+        {
+            // driver returns at the complete terminator,
+            // which it counts but cuts off
+            readStrategy = "eos";
+            bytesToRead = safeLength + deveoslen;
+        }
+        else
+        {
+            // Pseudo formats like regsub may change the input,
+            // then valid replies may be shorter: peek 1 byte.
+            readStrategy = "peek";
+            if (!pseudo && bytesToRead < safeLength)
+                bytesToRead = safeLength;
+        }
+        if (bytesToRead > buffersize) bytesToRead = buffersize;
+        firstReadSize = bytesToRead;
     }
+    bool learnReply = (ioAction == Read);
+    size_t replyLength = 0;
     bool waitForReply = true;
     size_t received;
     int eomReason;
@@ -1026,6 +1651,7 @@ readHandler()
                     eomReason &= ~ASYN_EOM_EOS;
                 }
 
+                if ((ssize_t)received > 0) replyLength += received;
                 readMore = readCallback(
                     eomReason & (ASYN_EOM_END|ASYN_EOM_EOS) ?
                     StreamIoEnd : StreamIoSuccess,
@@ -1067,6 +1693,7 @@ readHandler()
                     readCallback(StreamIoTimeout, NULL, 0);
                     break;
                 }
+                if ((ssize_t)received > 0) replyLength += received;
                 readMore = readCallback(StreamIoTimeout, buffer, received);
                 break;
             case asynOverflow:
@@ -1134,12 +1761,18 @@ readHandler()
         waitForReply = false;
     }
 
+    // remember the shortest reply for the next first read
+    if (learnReply && replyLength &&
+        (!shortestReply || replyLength < shortestReply))
+    {
+        rememberReply(replyCommand, replyLength);
+    }
+
     // restore original EOS
     if (oldeoslen >= 0 && oldeoslen != (int)deveoslen &&
         strcmp(deveos, oldeos) != 0)
     {
-        pasynOctet->setInputEos(pvtOctet, pasynUser,
-            oldeos, oldeoslen);
+        setInputEos(oldeos, oldeoslen);
         debug("AsynDriverInterface::readHandler(%s) "
             "input EOS restored to \"%s\"\n",
             clientName(),
@@ -1157,7 +1790,176 @@ intrCallbackOctet(char *data, size_t numchars, int eomReason)
 //    internal buffer of asynDriver.
 
     if (!interruptAccept) return; // too early to process records
-    asynReadHandler(data, numchars, eomReason);
+    if (framer)
+        framedReadHandler(data, numchars, eomReason);
+    else
+        asynReadHandler(data, numchars, eomReason);
+}
+
+// get asynchronous input already split into messages
+void AsynDriverInterface::
+framedReadHandler(const char *buffer, size_t received, int eomReason)
+{
+    // The asynDriver calls all interrupt users one after the other
+    // with the same input. The first client which gets new input
+    // splits it for all clients of the framer.
+
+    if (framerChunk == framer->chunk)
+    {
+        char deveos[16];
+        int deveoslen = 0;
+        if (eomReason & ASYN_EOM_EOS)
+        {
+            // Terminator was cut off. Restore it.
+            if (getInputEos(deveos, sizeof(deveos)-1, &deveoslen) != asynSuccess)
+                deveoslen = 0;
+        }
+        framer->split(buffer, received, deveos, deveoslen,
+            eomReason & ASYN_EOM_END);
+    }
+    framerChunk = framer->chunk;
+
+    debug("AsynDriverInterface::framedReadHandler(%s, messages=\"%s\") ioAction=%s\n",
+        clientName(), framer->messages.expand()(), toStr(ioAction));
+
+    // Incomplete input stays in the framer.
+    // Keep polling until a message is complete.
+    if (!framer->messages) return;
+
+    const char* message;
+    ssize_t len;
+    int i;
+    for (i = 0, message = framer->messages();
+        message < framer->messages.end(); i++, message += len)
+    {
+        memcpy(&len, message, sizeof(len));
+        message += sizeof(len);
+        if (ioAction == AsyncRead &&
+            !framer->prefixMatches(framerPrefix, framerGeneration, i))
+        {
+            // waiting in an in command which cannot match
+            framer->skipped++;
+            continue;
+        }
+        // like in asynReadHandler() a pending poll is now obsolete
+        ioAction = None;
+        framer->dispatched++;
+        readCallback(StreamIoEnd, message, len);
+    }
+}
+
+// EOS access through the per port cache
+// Other asyn users of the port (asynRecord, asynOctetSetInputEos,
+// other drivers) may change the EOS behind our back, thus the cache
+// is only used if streamEosCache is set.
+
+asynStatus AsynDriverInterface::
+getInputEos(char* eos, int size, int* eoslen)
+{
+    if (streamEosCache && portState->inputValid &&
+        (int)portState->inputEos.length() < size)
+    {
+        *eoslen = (int)portState->inputEos.length();
+        memcpy(eos, portState->inputEos(), *eoslen);
+        if (*eoslen < size) eos[*eoslen] = 0;
+        portState->skipped++;
+        return asynSuccess;
+    }
+    asynStatus status = pasynOctet->getInputEos(pvtOctet,
+        pasynUser, eos, size, eoslen);
+    portState->calls++;
+    if (status == asynSuccess)
+    {
+        if (*eoslen < size) eos[*eoslen] = 0;
+        portState->inputEos.set(eos, *eoslen);
+        portState->inputValid = true;
+    }
+    return status;
+}
+
+asynStatus AsynDriverInterface::
+setInputEos(const char* eos, int eoslen)
+{
+    if (streamEosCache && portState->inputValid &&
+        portState->inputEos.length() == (size_t)eoslen &&
+        portState->inputEos.startswith(eos, eoslen))
+    {
+        portState->skipped++;
+        return asynSuccess;
+    }
+    asynStatus status = pasynOctet->setInputEos(pvtOctet,
+        pasynUser, eos, eoslen);
+    portState->calls++;
+    portState->inputValid = (status == asynSuccess);
+    if (status == asynSuccess)
+        portState->inputEos.set(eos, eoslen);
+    return status;
+}
+
+asynStatus AsynDriverInterface::
+getOutputEos(char* eos, int size, int* eoslen)
+{
+    if (streamEosCache && portState->outputValid &&
+        (int)portState->outputEos.length() < size)
+    {
+        *eoslen = (int)portState->outputEos.length();
+        memcpy(eos, portState->outputEos(), *eoslen);
+        if (*eoslen < size) eos[*eoslen] = 0;
+        portState->skipped++;
+        return asynSuccess;
+    }
+    asynStatus status = pasynOctet->getOutputEos(pvtOctet,
+        pasynUser, eos, size, eoslen);
+    portState->calls++;
+    if (status == asynSuccess)
+    {
+        if (*eoslen < size) eos[*eoslen] = 0;
+        portState->outputEos.set(eos, *eoslen);
+        portState->outputValid = true;
+    }
+    return status;
+}
+
+asynStatus AsynDriverInterface::
+setOutputEos(const char* eos, int eoslen)
+{
+    if (streamEosCache && portState->outputValid &&
+        portState->outputEos.length() == (size_t)eoslen &&
+        portState->outputEos.startswith(eos, eoslen))
+    {
+        portState->skipped++;
+        return asynSuccess;
+    }
+    asynStatus status = pasynOctet->setOutputEos(pvtOctet,
+        pasynUser, eos, eoslen);
+    portState->calls++;
+    portState->outputValid = (status == asynSuccess);
+    if (status == asynSuccess)
+        portState->outputEos.set(eos, eoslen);
+    return status;
+}
+
+void AsynDriverInterface::
+printStatus(StreamBuffer& buffer)
+{
+    if (readStrategy)
+    {
+        buffer.print(" read strategy=%s first=%" Z "u shortest=%" Z "u",
+            readStrategy, firstReadSize, shortestReply);
+    }
+    if (portState)
+    {
+        buffer.print(" eos calls=%lu skipped=%lu",
+            portState->calls, portState->skipped);
+        buffer.print(" input drained=%lu bytes flushed=%lu times",
+            portState->drained, portState->flushes);
+    }
+    if (framer)
+    {
+        buffer.print(" framer lines=%lu dispatched=%lu skipped=%lu unmatched=%lu",
+            framer->lines, framer->dispatched, framer->skipped,
+            framer->unmatched);
+    }
 }
 
 // get asynchronous input
@@ -1212,8 +2014,7 @@ asynReadHandler(const char *buffer, size_t received, int eomReason)
             else
             {
                 // Try to add terminator
-                status = pasynOctet->getInputEos(pvtOctet,
-                    pasynUser, deveos, sizeof(deveos)-1, &deveoslen);
+                status = getInputEos(deveos, sizeof(deveos)-1, &deveoslen);
                 if (status == asynSuccess)
                 {
                     // We can't just append terminator to buffer, because
@@ -1230,8 +2031,7 @@ asynReadHandler(const char *buffer, size_t received, int eomReason)
         {
             // If terminator was not cut off and terminator was not
             // set by stream, cut it off now.
-            status = pasynOctet->getInputEos(pvtOctet,
-                pasynUser, deveos, sizeof(deveos)-1, &deveoslen);
+            status = getInputEos(deveos, sizeof(deveos)-1, &deveoslen);
             if (status == asynSuccess && (long)received >= (long)deveoslen)
             {
                 int i;
@@ -1322,6 +2122,9 @@ exceptionHandler(asynException exception)
     debug("AsynDriverInterface::exceptionHandler(%s, %s)\n",
         clientName(), toStr(exception));
 
+    // the driver may have changed its EOS
+    if (portState) portState->invalidate();
+
     if (exception == asynExceptionConnect)
     {
         pasynManager->isConnected(pasynUser, &connected);
@@ -1493,36 +2296,47 @@ void AsynDriverInterface::
 handleRequest()
 {
     cancelTimer();
-    debug("AsynDriverInterface::handleRequest(%s) %s\n",
-        clientName(), toStr(ioAction));
-    switch (ioAction)
-    {
-        case None:
-            // ignore obsolete poll request
-            // see asynReadHandler()
-            break;
-        case Lock:
-            lockHandler();
-            break;
-        case Write:
-            writeHandler();
-            break;
-        case AsyncRead: // polled async input
-        case AsyncReadMore:
-        case Read:      // sync input
-            readHandler();
-            break;
-        case Connect:
-            connectHandler();
-            break;
-        case Disconnect:
-            disconnectHandler();
-            break;
-        default:
-            error("INTERNAL ERROR (%s): "
-                "handleRequest() unexpected ioAction %s\n",
-                clientName(), toStr(ioAction));
-    }
+#ifdef EPICS_3_13
+    handlerThread = taskIdSelf();
+#else
+    handlerThread = epicsThreadGetIdSelf();
+#endif
+    inHandleRequest = true;
+    do {
+        // handlers may issue the next request, e.g. out followed by in
+        requestPending = false;
+        debug("AsynDriverInterface::handleRequest(%s) %s\n",
+            clientName(), toStr(ioAction));
+        switch (ioAction)
+        {
+            case None:
+                // ignore obsolete poll request
+                // see asynReadHandler()
+                break;
+            case Lock:
+                lockHandler();
+                break;
+            case Write:
+                writeHandler();
+                break;
+            case AsyncRead: // polled async input
+            case AsyncReadMore:
+            case Read:      // sync input
+                readHandler();
+                break;
+            case Connect:
+                connectHandler();
+                break;
+            case Disconnect:
+                disconnectHandler();
+                break;
+            default:
+                error("INTERNAL ERROR (%s): "
+                    "handleRequest() unexpected ioAction %s\n",
+                    clientName(), toStr(ioAction));
+        }
+    } while (requestPending);
+    inHandleRequest = false;
 }
 
 void AsynDriverInterface::
@@ -1606,6 +2420,9 @@ static void AsynDriverInterfaceRegistrar ()
 
 extern "C" {
 epicsExportRegistrar(AsynDriverInterfaceRegistrar);
+epicsExportAddress(int, streamCombineRequests);
+epicsExportAddress(int, streamEosCache);
+epicsExportAddress(int, streamFlushInput);
 }
 
 #endif
@@ -30,6 +30,8 @@ class RawConverter : public StreamFormatConverter
     int parse(const StreamFormat&, StreamBuffer&, const char*&, bool);
     bool printLong(const StreamFormat&, StreamBuffer&, long);
     ssize_t scanLong(const StreamFormat&, const char*, long&);
+    ssize_t scanArray(const StreamFormat&, const char*, size_t,
+        void*, size_t, size_t&);
 };
 
 int RawConverter::
@@ -155,4 +157,21 @@ scanLong(const StreamFormat& fmt, const char* input, long& value)
     return consumed;
 }
 
+ssize_t RawConverter::
+scanArray(const StreamFormat& fmt, const char* input, size_t length,
+    void* values, size_t size, size_t& count)
+{
+    unsigned long width = fmt.width;
+    if (width == 0) width = 1; // default: 1 byte
+    // Only if elements have the same size as the input values.
+    // Then sign or zero extension does not matter.
+    if (fmt.flags & skip_flag || width != size || size > sizeof(long))
+        return -1;
+    if (size != 1 && size != 2 && size != 4 && size != 8)
+        return -1;
+    if (count > length / size) count = length / size;
+    copyElements(values, input, size, count, (fmt.flags & alt_flag) != 0);
+    return count * size;
+}
+
 RegisterConverter (RawConverter, "r");
@@ -32,6 +32,8 @@ class RawFloatConverter : public StreamFormatConverter
     int parse(const StreamFormat&, StreamBuffer&, const char*&, bool);
     bool printDouble(const StreamFormat&, StreamBuffer&, double);
     ssize_t scanDouble(const StreamFormat&, const char*, double&);
+    ssize_t scanArray(const StreamFormat&, const char*, size_t,
+        void*, size_t, size_t&);
 };
 
 int RawFloatConverter::
@@ -135,4 +137,22 @@ scanDouble(const StreamFormat& format, const char* input, double& value)
     return nbOfBytes;
 }
 
+ssize_t RawFloatConverter::
+scanArray(const StreamFormat& format, const char* input, size_t length,
+    void* values, size_t size, size_t& count)
+{
+    size_t nbOfBytes;
+
+    nbOfBytes = format.width;
+    if (nbOfBytes == 0)
+        nbOfBytes = 4;
+
+    // Only if elements are floats of the same size as the input values
+    if (format.flags & skip_flag || nbOfBytes != size)
+        return -1;
+    if (count > length / size) count = length / size;
+    copyElements(values, input, size, count, (format.flags & alt_flag) != 0);
+    return count * size;
+}
+
 RegisterConverter (RawFloatConverter, "R");
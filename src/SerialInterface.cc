@@ -0,0 +1,336 @@
+/*************************************************************************
+* This is the native serial bus interface for StreamDevice.
+* Please see ../docs/ for detailed documentation.
+*
+* This file is part of StreamDevice.
+*
+* StreamDevice is free software: You can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* StreamDevice is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with StreamDevice. If not, see https://www.gnu.org/licenses/.
+*************************************************************************/
+
+#include <stdio.h>
+#include "StreamFdPort.h"
+
+#ifdef WITH_EVENTLOOP
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#endif
+
+#include "iocsh.h"
+#include "StreamBusInterface.h"
+#include "StreamError.h"
+#include "StreamBuffer.h"
+#include "epicsExport.h"
+
+#ifdef WITH_EVENTLOOP
+
+// streamSerialConfigure "port", "/dev/ttyS1", "baud=9600 bits=8 ..."
+// creates a SerialPort. All I/O is done by StreamFdPort, this only opens
+// the tty in raw mode. The options use the names of asynSetOption.
+
+class SerialPort : StreamFdPort
+{
+    speed_t speed;
+    tcflag_t cflag;
+    tcflag_t iflag;
+
+    SerialPort(const char* name, const char* device,
+        speed_t speed, tcflag_t cflag, tcflag_t iflag);
+
+    // StreamFdPort methods
+    void open();
+
+public:
+    static long configure(const char* name, const char* device,
+        const char* options);
+};
+
+class SerialInterface : StreamFdInterface
+{
+    SerialInterface(Client* client, StreamFdPort* port) :
+        StreamFdInterface(client, port) {}
+
+public:
+    // static creator method
+    static StreamBusInterface* getBusInterface(Client* client,
+        const char* busname, int addr, const char* param);
+};
+
+RegisterStreamBusInterface(SerialInterface);
+
+static const struct {
+    unsigned long baud;
+    speed_t speed;
+} speeds[] = {
+    { 50, B50 }, { 75, B75 }, { 110, B110 }, { 134, B134 },
+    { 150, B150 }, { 200, B200 }, { 300, B300 }, { 600, B600 },
+    { 1200, B1200 }, { 1800, B1800 }, { 2400, B2400 }, { 4800, B4800 },
+    { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 },
+#ifdef B57600
+    { 57600, B57600 },
+#endif
+#ifdef B115200
+    { 115200, B115200 },
+#endif
+#ifdef B230400
+    { 230400, B230400 },
+#endif
+#ifdef B460800
+    { 460800, B460800 },
+#endif
+#ifdef B921600
+    { 921600, B921600 },
+#endif
+    { 0, B0 }
+};
+
+SerialPort::
+SerialPort(const char* name, const char* device,
+    speed_t speed, tcflag_t cflag, tcflag_t iflag) :
+    StreamFdPort("serial", name, device),
+    speed(speed), cflag(cflag), iflag(iflag)
+{
+}
+
+// Same option names and values as asynSetOption of asyn serial ports.
+static bool
+parseOption(const char* key, const char* value,
+    speed_t& speed, tcflag_t& cflag, tcflag_t& iflag)
+{
+    bool yes = (value[0] == 'Y' || value[0] == 'y');
+    int i;
+
+    if (strcmp(key, "baud") == 0)
+    {
+        unsigned long baud = strtoul(value, NULL, 10);
+        for (i = 0; speeds[i].baud; i++)
+        {
+            if (speeds[i].baud == baud)
+            {
+                speed = speeds[i].speed;
+                return true;
+            }
+        }
+        return false;
+    }
+    if (strcmp(key, "bits") == 0)
+    {
+        cflag &= ~CSIZE;
+        switch (value[0])
+        {
+            case '5': cflag |= CS5; return true;
+            case '6': cflag |= CS6; return true;
+            case '7': cflag |= CS7; return true;
+            case '8': cflag |= CS8; return true;
+        }
+        return false;
+    }
+    if (strcmp(key, "parity") == 0)
+    {
+        cflag &= ~(PARENB|PARODD);
+#ifdef CMSPAR
+        cflag &= ~CMSPAR;
+#endif
+        iflag &= ~INPCK;
+        if (strcmp(value, "none") == 0) return true;
+        iflag |= INPCK;
+        if (strcmp(value, "even") == 0)
+        {
+            cflag |= PARENB;
+            return true;
+        }
+        if (strcmp(value, "odd") == 0)
+        {
+            cflag |= PARENB|PARODD;
+            return true;
+        }
+#ifdef CMSPAR
+        if (strcmp(value, "mark") == 0)
+        {
+            cflag |= PARENB|PARODD|CMSPAR;
+            return true;
+        }
+        if (strcmp(value, "space") == 0)
+        {
+            cflag |= PARENB|CMSPAR;
+            return true;
+        }
+#endif
+        return false;
+    }
+    if (strcmp(key, "stop") == 0)
+    {
+        if (value[0] == '1') cflag &= ~CSTOPB;
+        else if (value[0] == '2') cflag |= CSTOPB;
+        else return false;
+        return true;
+    }
+    if (strcmp(key, "clocal") == 0)
+    {
+        if (yes) cflag |= CLOCAL; else cflag &= ~CLOCAL;
+        return true;
+    }
+    if (strcmp(key, "crtscts") == 0)
+    {
+        if (yes) cflag |= CRTSCTS; else cflag &= ~CRTSCTS;
+        return true;
+    }
+    if (strcmp(key, "ixon") == 0)
+    {
+        if (yes) iflag |= IXON; else iflag &= ~IXON;
+        return true;
+    }
+    if (strcmp(key, "ixoff") == 0)
+    {
+        if (yes) iflag |= IXOFF; else iflag &= ~IXOFF;
+        return true;
+    }
+    if (strcmp(key, "ixany") == 0)
+    {
+        if (yes) iflag |= IXANY; else iflag &= ~IXANY;
+        return true;
+    }
+    return false;
+}
+
+long SerialPort::
+configure(const char* name, const char* device, const char* options)
+{
+    // defaults like asyn: 9600 baud, 8N1, no flow control
+    speed_t speed = B9600;
+    tcflag_t cflag = CS8|CLOCAL|CREAD;
+    tcflag_t iflag = IGNBRK;
+    char key[16];
+    char value[16];
+    int n;
+
+    if (!name || !device)
+    {
+        fprintf(stderr, "Usage: streamSerialConfigure \"portname\", "
+            "\"device\", \"baud=9600 bits=8 parity=none stop=1 ...\"\n");
+        return -1;
+    }
+    if (find(name))
+    {
+        fprintf(stderr, "streamSerialConfigure: port %s already exists\n",
+            name);
+        return -1;
+    }
+    // key=value pairs separated by spaces or commas
+    while (options && *options)
+    {
+        options += strspn(options, " ,");
+        if (!*options) break;
+        if (sscanf(options, "%15[^=]=%15[^ ,]%n", key, value, &n) != 2 ||
+            !parseOption(key, value, speed, cflag, iflag))
+        {
+            fprintf(stderr, "streamSerialConfigure: %s: invalid option %s\n",
+                name, StreamBuffer(options, strcspn(options, " ,"))());
+            return -1;
+        }
+        options += n;
+    }
+    SerialPort* port = new SerialPort(name, device, speed, cflag, iflag);
+    port->start();
+    return 0;
+}
+
+void SerialPort::
+open()
+{
+    struct termios tio;
+
+    fd = ::open(hostInfo, O_RDWR|O_NOCTTY|O_NONBLOCK|O_CLOEXEC);
+    if (fd < 0)
+    {
+        openFailed(errno);
+        return;
+    }
+    // raw mode: all bytes as they are, terminators are found by StreamCore
+    memset(&tio, 0, sizeof(tio));
+    tio.c_cflag = cflag;
+    tio.c_iflag = iflag;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(fd, TCSANOW, &tio) != 0)
+    {
+        openFailed(errno);
+        return;
+    }
+    // old input is no reply to anything
+    tcflush(fd, TCIFLUSH);
+    opened();
+}
+
+StreamBusInterface* SerialInterface::
+getBusInterface(Client* client,
+    const char* busname, int addr, const char*)
+{
+    StreamFdPort* port = findPort(busname, addr, "serial");
+    if (!port) return NULL;
+    SerialInterface* interface = new SerialInterface(client, port);
+    debug ("SerialInterface::getBusInterface(%s, %d): "
+        "new interface allocated\n",
+        busname, addr);
+    return interface;
+}
+
+extern "C" long streamSerialConfigure(const char* portname,
+    const char* device, const char* options)
+{
+    return SerialPort::configure(portname, device, options);
+}
+
+#else
+
+// No epoll on this system. Records cannot find any port.
+void* ref_SerialInterface = NULL;
+
+extern "C" long streamSerialConfigure(const char*, const char*, const char*)
+{
+    fprintf(stderr, "streamSerialConfigure: not supported on this system\n");
+    return -1;
+}
+
+#endif
+
+static const iocshArg streamSerialConfigureArg0 =
+    { "portname", iocshArgString };
+static const iocshArg streamSerialConfigureArg1 =
+    { "device", iocshArgString };
+static const iocshArg streamSerialConfigureArg2 =
+    { "options", iocshArgString };
+static const iocshArg * const streamSerialConfigureArgs[] =
+    { &streamSerialConfigureArg0, &streamSerialConfigureArg1,
+      &streamSerialConfigureArg2 };
+static const iocshFuncDef streamSerialConfigureDef =
+    { "streamSerialConfigure", 3, streamSerialConfigureArgs };
+
+void streamSerialConfigureFunc(const iocshArgBuf *args)
+{
+    streamSerialConfigure(args[0].sval, args[1].sval, args[2].sval);
+}
+
+static void SerialInterfaceRegistrar ()
+{
+     iocshRegister(&streamSerialConfigureDef, streamSerialConfigureFunc);
+}
+
+extern "C" {
+epicsExportRegistrar(SerialInterfaceRegistrar);
+}
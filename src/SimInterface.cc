@@ -0,0 +1,619 @@
+/*************************************************************************
+* This is the device simulator bus interface for StreamDevice.
+* Please see ../docs/ for detailed documentation.
+*
+* This file is part of StreamDevice.
+*
+* StreamDevice is free software: You can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* StreamDevice is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with StreamDevice. If not, see https://www.gnu.org/licenses/.
+*************************************************************************/
+
+#include <stdio.h>
+#include "StreamFdPort.h"
+
+#ifdef WITH_EVENTLOOP
+#include <stdlib.h>
+#include "epicsString.h"
+#endif
+
+#include "iocsh.h"
+#include "StreamBusInterface.h"
+#include "StreamError.h"
+#include "StreamBuffer.h"
+#include "epicsExport.h"
+
+#ifdef WITH_EVENTLOOP
+
+/* How things are implemented:
+
+streamSimConfigure "port", "latency=10 jitter=5 chunk=4 ..." creates a
+SimPort with a simulated device instead of a connection. Records use it
+like any other port, through the whole StreamCore protocol engine.
+
+streamSimRule "port", "pattern", "reply" teaches the device what to answer.
+Each write (or each part up to the terminator option) is a request.
+The first rule whose pattern matches the whole request wins.
+In the pattern, '*' matches any text and '?' any single character.
+In the reply, $1 ... $9 insert what the '*'s matched, $$ is a '$'.
+Requests which match no rule get no reply.
+
+streamSimUnsolicited "port", "text", period_ms lets the device send
+text every period_ms, or once if period_ms is 0.
+
+The device sends its output like a serial line: a reply starts after
+latency plus a random jitter, in pieces of chunk bytes every chunkdelay.
+Output queued while the device still sends follows without new latency.
+The device has its own timer in the event loop thread of the port and
+passes its output to StreamFdPort as if it had been read from a socket.
+Thus timeouts, I/O Intr and the lock queue work as with real devices.
+The random numbers start with the same seed each time.
+*/
+
+class SimPort : StreamFdPort
+{
+    class Device : public StreamEventLoop::Source
+    {
+        SimPort* port;
+
+        void timerExpired() { port->deviceTimer(); }
+
+    public:
+        Device(SimPort* port, StreamEventLoop* loop) :
+            StreamEventLoop::Source(loop), port(port) {}
+        ~Device() { detach(); }
+        void start(unsigned long ms) { startTimer(ms); }
+        void cancel() { cancelTimer(); }
+    };
+
+    struct Rule
+    {
+        Rule* next;
+        StreamBuffer pattern;
+        StreamBuffer reply;
+        unsigned long matches;
+    };
+
+    Rule* rules;
+    unsigned long latency;
+    unsigned long jitter;
+    size_t chunkSize;         // 0: whole output at once
+    unsigned long chunkDelay;
+    StreamBuffer terminator;  // empty: each write is a request
+    StreamBuffer request;     // partial request
+    StreamBuffer pending;     // output of the device not yet sent
+    unsigned long long sendAt;
+    StreamBuffer unsolicited;
+    unsigned long period;
+    unsigned long long unsolicitedAt;
+    unsigned int seed;
+    unsigned long requests;
+    unsigned long replies;
+    unsigned long unmatched;
+    unsigned long sends;
+    Device device;
+
+    SimPort(const char* name);
+
+    void handleRequest(const char* req, size_t len);
+    void emit(const StreamBuffer& output, unsigned long delay);
+    void transmit();
+    void schedule();
+    void deviceTimer();
+    unsigned long random(unsigned long range);
+
+    // StreamFdPort methods
+    void open();
+    ssize_t writeBytes(const void* output, size_t size);
+    void printStatus(StreamBuffer& buffer);
+
+public:
+    static SimPort* find(const char* name, const char* command);
+    static long configure(const char* name, const char* options);
+    static long addRule(const char* name, const char* pattern,
+        const char* reply);
+    static long setUnsolicited(const char* name, const char* text,
+        int period_ms);
+};
+
+class SimInterface : StreamFdInterface
+{
+    SimInterface(Client* client, StreamFdPort* port) :
+        StreamFdInterface(client, port) {}
+
+public:
+    // static creator method
+    static StreamBusInterface* getBusInterface(Client* client,
+        const char* busname, int addr, const char* param);
+};
+
+RegisterStreamBusInterface(SimInterface);
+
+// Convert C style escapes like \r\n in iocsh arguments.
+static void
+unescape(StreamBuffer& buffer, const char* s)
+{
+    size_t len = strlen(s);
+    buffer.clear();
+    buffer.truncate(epicsStrnRawFromEscaped(buffer.reserve(len + 1), len + 1,
+        s, len));
+}
+
+static bool
+parseNumber(const char* value, unsigned long& n)
+{
+    char* end;
+    n = strtoul(value, &end, 10);
+    return *value && !*end;
+}
+
+SimPort::
+SimPort(const char* name) :
+    StreamFdPort("sim", name, "simulator"),
+    device(this, loop)
+{
+    rules = NULL;
+    latency = 0;
+    jitter = 0;
+    chunkSize = 0;
+    chunkDelay = 0;
+    sendAt = 0;
+    period = 0;
+    unsolicitedAt = 0;
+    seed = 1;
+    requests = 0;
+    replies = 0;
+    unmatched = 0;
+    sends = 0;
+}
+
+SimPort* SimPort::
+find(const char* name, const char* command)
+{
+    StreamFdPort* port = StreamFdPort::find(name, "sim");
+    if (!port)
+    {
+        fprintf(stderr, "%s: sim port %s not found\n", command, name);
+        return NULL;
+    }
+    return static_cast<SimPort*>(port);
+}
+
+long SimPort::
+configure(const char* name, const char* options)
+{
+    unsigned long latency = 0;
+    unsigned long jitter = 0;
+    unsigned long chunkSize = 0;
+    unsigned long chunkDelay = 0;
+    unsigned long seed = 1;
+    StreamBuffer terminator;
+    char key[16];
+    char value[64];
+    bool ok = true;
+    int len;
+
+    if (!name)
+    {
+        fprintf(stderr, "Usage: streamSimConfigure \"portname\", "
+            "\"latency=0 jitter=0 chunk=0 chunkdelay=0 terminator=\\n\"\n");
+        return -1;
+    }
+    if (StreamFdPort::find(name))
+    {
+        fprintf(stderr, "streamSimConfigure: port %s already exists\n",
+            name);
+        return -1;
+    }
+    // key=value pairs separated by spaces or commas
+    while (options && *options)
+    {
+        options += strspn(options, " ,");
+        if (!*options) break;
+        if (sscanf(options, "%15[^=]=%63[^ ,]%n", key, value, &len) != 2)
+            ok = false;
+        else if (strcmp(key, "terminator") == 0)
+            unescape(terminator, value);
+        else if (strcmp(key, "latency") == 0)
+            ok = parseNumber(value, latency);
+        else if (strcmp(key, "jitter") == 0)
+            ok = parseNumber(value, jitter);
+        else if (strcmp(key, "chunk") == 0)
+            ok = parseNumber(value, chunkSize);
+        else if (strcmp(key, "chunkdelay") == 0)
+            ok = parseNumber(value, chunkDelay);
+        else if (strcmp(key, "seed") == 0)
+            ok = parseNumber(value, seed);
+        else
+            ok = false;
+        if (!ok)
+        {
+            fprintf(stderr, "streamSimConfigure: %s: invalid option %s\n",
+                name, StreamBuffer(options, strcspn(options, " ,"))());
+            return -1;
+        }
+        options += len;
+    }
+    SimPort* port = new SimPort(name);
+    port->latency = latency;
+    port->jitter = jitter;
+    port->chunkSize = chunkSize;
+    port->chunkDelay = chunkDelay;
+    port->seed = seed;
+    port->terminator = terminator;
+    port->start();
+    return 0;
+}
+
+long SimPort::
+addRule(const char* name, const char* pattern, const char* reply)
+{
+    SimPort* port;
+    Rule** pr;
+
+    if (!name || !pattern)
+    {
+        fprintf(stderr, "Usage: streamSimRule \"portname\", "
+            "\"request pattern\", \"reply\"\n");
+        return -1;
+    }
+    port = find(name, "streamSimRule");
+    if (!port) return -1;
+    Rule* rule = new Rule;
+    rule->next = NULL;
+    rule->matches = 0;
+    unescape(rule->pattern, pattern);
+    if (reply) unescape(rule->reply, reply);
+    // rules are tried in the order they were added
+    port->mutex.lock();
+    for (pr = &port->rules; *pr; pr = &(*pr)->next);
+    *pr = rule;
+    port->mutex.unlock();
+    return 0;
+}
+
+long SimPort::
+setUnsolicited(const char* name, const char* text, int period_ms)
+{
+    SimPort* port;
+
+    if (!name)
+    {
+        fprintf(stderr, "Usage: streamSimUnsolicited \"portname\", "
+            "\"text\", period_ms\n");
+        return -1;
+    }
+    port = find(name, "streamSimUnsolicited");
+    if (!port) return -1;
+    port->mutex.lock();
+    port->unsolicited.clear();
+    port->period = 0;
+    if (text && *text)
+    {
+        unescape(port->unsolicited, text);
+        if (period_ms > 0)
+        {
+            port->period = period_ms;
+            port->unsolicitedAt = StreamEventLoop::now() + period_ms;
+        }
+        else
+            port->emit(port->unsolicited, 0);
+    }
+    port->schedule();
+    port->mutex.unlock();
+    return 0;
+}
+
+// Deterministic, thus benchmarks with jitter are repeatable.
+unsigned long SimPort::
+random(unsigned long range)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % (range + 1);
+}
+
+void SimPort::
+open()
+{
+    opened();
+}
+
+// Match a glob pattern against the whole input.
+// Remember what each '*' has matched.
+static bool
+match(const char* p, const char* pend, const char* s, const char* send,
+    const char** captures, int n)
+{
+    while (p < pend)
+    {
+        if (*p == '*')
+        {
+            // shortest match first
+            for (const char* t = s; t <= send; t++)
+            {
+                if (match(p + 1, pend, t, send, captures, n + 1))
+                {
+                    if (n < 9)
+                    {
+                        captures[2 * n] = s;
+                        captures[2 * n + 1] = t;
+                    }
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (s == send || (*p != '?' && *p != *s)) return false;
+        p++;
+        s++;
+    }
+    return s == send;
+}
+
+void SimPort::
+handleRequest(const char* req, size_t len)
+{
+    const char* captures[18];
+    StreamBuffer reply;
+    Rule* rule;
+    size_t i;
+    int n;
+
+    requests++;
+    for (rule = rules; rule; rule = rule->next)
+    {
+        memset(captures, 0, sizeof(captures));
+        if (match(rule->pattern(), rule->pattern.end(), req, req + len,
+            captures, 0)) break;
+    }
+    if (!rule)
+    {
+        unmatched++;
+        debug("SimPort::handleRequest(%s): no rule for \"%s\"\n",
+            name, StreamBuffer(req, len).expand()());
+        return;
+    }
+    rule->matches++;
+    for (i = 0; i < rule->reply.length(); i++)
+    {
+        char c = rule->reply[i];
+        if (c == '$' && i + 1 < rule->reply.length())
+        {
+            c = rule->reply[i + 1];
+            if (c >= '1' && c <= '9')
+            {
+                n = c - '1';
+                if (captures[2 * n])
+                    reply.append(captures[2 * n],
+                        captures[2 * n + 1] - captures[2 * n]);
+                i++;
+                continue;
+            }
+            if (c == '$') i++;
+            c = '$';
+        }
+        reply.append(c);
+    }
+    debug("SimPort::handleRequest(%s): \"%s\" -> \"%s\"\n",
+        name, StreamBuffer(req, len).expand()(), reply.expand()());
+    if (!reply) return;
+    replies++;
+    emit(reply, latency + (jitter ? random(jitter) : 0));
+}
+
+// The device has received output from a record.
+ssize_t SimPort::
+writeBytes(const void* output, size_t size)
+{
+    ssize_t i;
+
+    if (!terminator)
+    {
+        handleRequest(static_cast<const char*>(output), size);
+        return size;
+    }
+    request.append(output, size);
+    while ((i = request.find(terminator)) >= 0)
+    {
+        handleRequest(request(), i);
+        request.remove(i + terminator.length());
+    }
+    return size;
+}
+
+// Queue output of the device.
+void SimPort::
+emit(const StreamBuffer& output, unsigned long delay)
+{
+    if (!pending) sendAt = StreamEventLoop::now() + delay;
+    pending.append(output);
+    schedule();
+}
+
+// Pass the next chunk of output to the records.
+void SimPort::
+transmit()
+{
+    size_t n = pending.length();
+
+    if (chunkSize && n > chunkSize) n = chunkSize;
+    chunk.set(pending(), n);
+    pending.remove(n);
+    sends++;
+    if (pending) sendAt = StreamEventLoop::now() + chunkDelay;
+    // received() may unlock the mutex, thus pending is already updated
+    if (state == Connected) received();
+}
+
+void SimPort::
+schedule()
+{
+    unsigned long long next = 0;
+    unsigned long long t;
+
+    if (pending) next = sendAt;
+    if (period && (!next || unsolicitedAt < next)) next = unsolicitedAt;
+    if (!next)
+    {
+        device.cancel();
+        return;
+    }
+    t = StreamEventLoop::now();
+    device.start(next > t ? (unsigned long)(next - t) : 0);
+}
+
+// Called in the loop thread.
+void SimPort::
+deviceTimer()
+{
+    unsigned long long t;
+
+    mutex.lock();
+    t = StreamEventLoop::now();
+    if (period && unsolicitedAt <= t)
+    {
+        unsolicitedAt += period;
+        if (unsolicitedAt <= t) unsolicitedAt = t + period;
+        emit(unsolicited, 0);
+    }
+    if (pending && sendAt <= t)
+        transmit();
+    schedule();
+    mutex.unlock();
+}
+
+void SimPort::
+printStatus(StreamBuffer& buffer)
+{
+    Rule* rule;
+    int n = 0;
+
+    for (rule = rules; rule; rule = rule->next) n++;
+    buffer.print("rules=%d requests=%lu replies=%lu unmatched=%lu"
+        " sends=%lu pending=%lu ",
+        n, requests, replies, unmatched, sends,
+        (unsigned long)pending.length());
+}
+
+StreamBusInterface* SimInterface::
+getBusInterface(Client* client,
+    const char* busname, int addr, const char*)
+{
+    StreamFdPort* port = findPort(busname, addr, "sim");
+    if (!port) return NULL;
+    SimInterface* interface = new SimInterface(client, port);
+    debug ("SimInterface::getBusInterface(%s, %d): "
+        "new interface allocated\n",
+        busname, addr);
+    return interface;
+}
+
+extern "C" long streamSimConfigure(const char* portname,
+    const char* options)
+{
+    return SimPort::configure(portname, options);
+}
+
+extern "C" long streamSimRule(const char* portname,
+    const char* pattern, const char* reply)
+{
+    return SimPort::addRule(portname, pattern, reply);
+}
+
+extern "C" long streamSimUnsolicited(const char* portname,
+    const char* text, int period_ms)
+{
+    return SimPort::setUnsolicited(portname, text, period_ms);
+}
+
+#else
+
+// No event loop on this system. Records cannot find any port.
+void* ref_SimInterface = NULL;
+
+extern "C" long streamSimConfigure(const char*, const char*)
+{
+    fprintf(stderr, "streamSimConfigure: not supported on this system\n");
+    return -1;
+}
+
+extern "C" long streamSimRule(const char*, const char*, const char*)
+{
+    fprintf(stderr, "streamSimRule: not supported on this system\n");
+    return -1;
+}
+
+extern "C" long streamSimUnsolicited(const char*, const char*, int)
+{
+    fprintf(stderr, "streamSimUnsolicited: not supported on this system\n");
+    return -1;
+}
+
+#endif
+
+static const iocshArg streamSimConfigureArg0 =
+    { "portname", iocshArgString };
+static const iocshArg streamSimConfigureArg1 =
+    { "options", iocshArgString };
+static const iocshArg * const streamSimConfigureArgs[] =
+    { &streamSimConfigureArg0, &streamSimConfigureArg1 };
+static const iocshFuncDef streamSimConfigureDef =
+    { "streamSimConfigure", 2, streamSimConfigureArgs };
+
+void streamSimConfigureFunc(const iocshArgBuf *args)
+{
+    streamSimConfigure(args[0].sval, args[1].sval);
+}
+
+static const iocshArg streamSimRuleArg0 =
+    { "portname", iocshArgString };
+static const iocshArg streamSimRuleArg1 =
+    { "request pattern", iocshArgString };
+static const iocshArg streamSimRuleArg2 =
+    { "reply", iocshArgString };
+static const iocshArg * const streamSimRuleArgs[] =
+    { &streamSimRuleArg0, &streamSimRuleArg1, &streamSimRuleArg2 };
+static const iocshFuncDef streamSimRuleDef =
+    { "streamSimRule", 3, streamSimRuleArgs };
+
+void streamSimRuleFunc(const iocshArgBuf *args)
+{
+    streamSimRule(args[0].sval, args[1].sval, args[2].sval);
+}
+
+static const iocshArg streamSimUnsolicitedArg0 =
+    { "portname", iocshArgString };
+static const iocshArg streamSimUnsolicitedArg1 =
+    { "text", iocshArgString };
+static const iocshArg streamSimUnsolicitedArg2 =
+    { "period_ms", iocshArgInt };
+static const iocshArg * const streamSimUnsolicitedArgs[] =
+    { &streamSimUnsolicitedArg0, &streamSimUnsolicitedArg1,
+      &streamSimUnsolicitedArg2 };
+static const iocshFuncDef streamSimUnsolicitedDef =
+    { "streamSimUnsolicited", 3, streamSimUnsolicitedArgs };
+
+void streamSimUnsolicitedFunc(const iocshArgBuf *args)
+{
+    streamSimUnsolicited(args[0].sval, args[1].sval, args[2].ival);
+}
+
+static void SimInterfaceRegistrar ()
+{
+     iocshRegister(&streamSimConfigureDef, streamSimConfigureFunc);
+     iocshRegister(&streamSimRuleDef, streamSimRuleFunc);
+     iocshRegister(&streamSimUnsolicitedDef, streamSimUnsolicitedFunc);
+}
+
+extern "C" {
+epicsExportRegistrar(SimInterfaceRegistrar);
+}
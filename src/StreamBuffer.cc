@@ -32,6 +32,11 @@
 #include <stdarg.h>
 #include <stdlib.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WITH_SSE2
+#endif
+
 #ifdef vxWorks
 #include <version.h>
 #ifndef _WRS_VXWORKS_MAJOR
@@ -162,6 +167,26 @@ grow(size_t minsize)
     offs = 0;
 }
 
+StreamBuffer& StreamBuffer::
+swap(StreamBuffer& s)
+{
+    // only the small local buffers need to be copied
+    char tmplocal[sizeof(local)];
+    char* tmpbuffer;
+    size_t tmp;
+
+    memcpy(tmplocal, local, sizeof(local));
+    memcpy(local, s.local, sizeof(local));
+    memcpy(s.local, tmplocal, sizeof(local));
+    tmpbuffer = buffer;
+    buffer = s.buffer == s.local ? local : s.buffer;
+    s.buffer = tmpbuffer == local ? s.local : tmpbuffer;
+    tmp = len; len = s.len; s.len = tmp;
+    tmp = cap; cap = s.cap; s.cap = tmp;
+    tmp = offs; offs = s.offs; s.offs = tmp;
+    return *this;
+}
+
 StreamBuffer& StreamBuffer::
 append(const void* s, ssize_t size)
 {
@@ -191,17 +216,41 @@ find(const void* m, size_t size, ssize_t start) const
     if (start+size > len) return -1; // find nothing after end
     if (!m || size <= 0) return start; // find empty string at start
     const char* s = static_cast<const char*>(m);
-    char* b = buffer+offs;
-    char* p = b+start;
-    size_t i;
-    while ((p = static_cast<char*>(memchr(p, s[0], b-p+len-size+1))))
+    const char* b = buffer+offs;
+    const char* p = b+start;
+    const char* last = b+len-size; // last possible match
+    if (size == 1)
+    {
+        p = static_cast<const char*>(memchr(p, s[0], last-p+1));
+        return p ? p-b : -1;
+    }
+    // Check first and last byte of the needle before comparing the rest.
+    // This avoids most useless compares if the first byte is frequent.
+#ifdef WITH_SSE2
+    // 16 positions at once
+    __m128i first = _mm_set1_epi8(s[0]);
+    __m128i lastc = _mm_set1_epi8(s[size-1]);
+    while (p+15 <= last)
     {
-        for (i = 1; i < size; i++)
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(first,
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+            _mm_cmpeq_epi8(lastc,
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(p+size-1)))));
+        for (int i = 0; mask; i++, mask >>= 1)
         {
-            if (p[i] != s[i]) goto next;
+            if ((mask & 1) && memcmp(p+i+1, s+1, size-2) == 0)
+                return p+i-b;
         }
-        return p-b;
-next:   p++;
+        p += 16;
+    }
+#endif
+    while (p <= last &&
+        (p = static_cast<const char*>(memchr(p, s[0], last-p+1))))
+    {
+        if (p[size-1] == s[size-1] && memcmp(p+1, s+1, size-2) == 0)
+            return p-b;
+        p++;
     }
     return -1;
 }
@@ -308,6 +357,8 @@ print(const char* fmt, ...)
             len += printed;
             return *this;
         }
+        // remove truncated output, end of buffer must be 0x00
+        memset(buffer+offs+len, 0, cap-offs-len);
         if (printed > -1) grow(len+printed);
         else grow(cap*2-1);
     }
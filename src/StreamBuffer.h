@@ -117,6 +117,10 @@ public:
     char* reserve(size_t size)
         {check(size); char* p=buffer+offs+len; len+=size; return p;}
 
+    // prealloc: make room for size more bytes without changing length
+    StreamBuffer& prealloc(size_t size)
+        {check(size); return *this;}
+
     // append: append data at the end of the buffer
     StreamBuffer& append(char c)
         {check(1); buffer[offs+len++]=c; return *this;}
@@ -161,6 +165,9 @@ public:
     StreamBuffer& operator=(const StreamBuffer& s)
         {return set(s);}
 
+    // swap: exchange contents with other buffer (no copy of data)
+    StreamBuffer& swap(StreamBuffer& s);
+
     // replace: delete part of buffer (pos/length) and insert new data
     StreamBuffer& replace(
         ssize_t pos, ssize_t length, const void* s, ssize_t size);
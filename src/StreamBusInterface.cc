@@ -167,3 +167,23 @@ priority()
 {
     return 0;
 }
+
+const char* StreamBusInterface::Client::
+getInPrefix(size_t& length)
+{
+    length = 0;
+    return NULL;
+}
+
+size_t StreamBusInterface::Client::
+getInMinLength(bool& pseudo)
+{
+    pseudo = false;
+    return 0;
+}
+
+const void* StreamBusInterface::Client::
+getInCommand()
+{
+    return NULL;
+}
@@ -50,6 +50,9 @@ public:
         virtual long priority();
         virtual const char* getInTerminator(size_t& length) = 0;
         virtual const char* getOutTerminator(size_t& length) = 0;
+        virtual const char* getInPrefix(size_t& length);
+        virtual size_t getInMinLength(bool& pseudo);
+        virtual const void* getInCommand();
     public:
         virtual const char* name() = 0;
         virtual ~Client();
@@ -129,6 +132,12 @@ protected:
         { return client->getInTerminator(length); }
     const char* getOutTerminator(size_t& length)
         { return client->getOutTerminator(length); }
+    const char* getInPrefix(size_t& length)
+        { return client->getInPrefix(length); }
+    size_t getInMinLength(bool& pseudo)
+        { return client->getInMinLength(pseudo); }
+    const void* getInCommand()
+        { return client->getInCommand(); }
     long priority() { return client->priority(); }
     const char* clientName() { return client->name(); }
 
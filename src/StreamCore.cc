@@ -27,6 +27,27 @@
 
 #define Z PRINTF_SIZE_T_PREFIX
 
+// Compiled formats contain the format string for messages.
+// Skip it quickly and decode it only when a message needs it.
+
+static const char* skipFormatString(const char* c)
+{
+    // formatstring <eos>
+    while (*c)
+    {
+        if (*c == esc) c++;
+        c++;
+    }
+    return c+1;
+}
+
+static const char* formatString(StreamBuffer& buffer, const char* c)
+{
+    buffer.clear();
+    StreamProtocolParser::printString(buffer, c);
+    return buffer();
+}
+
 /// debug functions /////////////////////////////////////////////
 
 char* StreamCore::
@@ -83,6 +104,11 @@ void StreamCore::
 printProtocol(FILE* file)
 {
     StreamBuffer buffer;
+    if (!compiled)
+    {
+        fprintf(file, "%s: no protocol loaded\n", protocolname());
+        return;
+    }
     fprintf(file, "%s {\n", protocolname());
     fprintf(file, "  extraInput    = %s;\n",
       (flags & IgnoreExtraInput) ? "ignore" : "error");
@@ -92,39 +118,91 @@ printProtocol(FILE* file)
     fprintf(file, "  writeTimeout  = %ld; # ms\n", writeTimeout);
     fprintf(file, "  pollPeriod    = %ld; # ms\n", pollPeriod);
     fprintf(file, "  maxInput      = %ld; # bytes\n", maxInput);
-    StreamProtocolParser::printString(buffer.clear(), inTerminator());
+    StreamProtocolParser::printString(buffer.clear(), compiled->inTerminator());
     fprintf(file, "  inTerminator  = \"%s\";\n", buffer());
-        StreamProtocolParser::printString(buffer.clear(), outTerminator());
+        StreamProtocolParser::printString(buffer.clear(), compiled->outTerminator());
     fprintf(file, "  outTerminator = \"%s\";\n", buffer());
-        StreamProtocolParser::printString(buffer.clear(), separator());
+        StreamProtocolParser::printString(buffer.clear(), compiled->separator());
     fprintf(file, "  separator     = \"%s\";\n", buffer());
-    if (onInit)
+    if (compiled->onInit)
         fprintf(file, "  @Init {\n%s  }\n",
-        printCommands(buffer.clear(), onInit()));
-    if (onReplyTimeout)
+        printCommands(buffer.clear(), compiled->onInit()));
+    if (compiled->onReplyTimeout)
         fprintf(file, "  @ReplyTimeout {\n%s  }\n",
-        printCommands(buffer.clear(), onReplyTimeout()));
-    if (onReadTimeout)
+        printCommands(buffer.clear(), compiled->onReplyTimeout()));
+    if (compiled->onReadTimeout)
         fprintf(file, "  @ReadTimeout {\n%s  }\n",
-        printCommands(buffer.clear(), onReadTimeout()));
-    if (onWriteTimeout)
+        printCommands(buffer.clear(), compiled->onReadTimeout()));
+    if (compiled->onWriteTimeout)
         fprintf(file, "  @WriteTimeout {\n%s  }\n",
-        printCommands(buffer.clear(), onWriteTimeout()));
-    if (onMismatch)
+        printCommands(buffer.clear(), compiled->onWriteTimeout()));
+    if (compiled->onMismatch)
         fprintf(file, "  @Mismatch {\n%s  }\n",
-        printCommands(buffer.clear(), onMismatch()));
+        printCommands(buffer.clear(), compiled->onMismatch()));
     fprintf(file, "\n%s}\n",
-        printCommands(buffer.clear(), commands()));
+        printCommands(buffer.clear(), compiled->commands()));
 }
 
 ///////////////////////////////////////////////////////////////////////////
 
 StreamCore* StreamCore::first = NULL;
+StreamCore::CompiledProtocol* StreamCore::CompiledProtocol::first = NULL;
+unsigned long StreamCore::CompiledProtocol::hits = 0;
+size_t StreamCore::CompiledProtocol::bytesSaved = 0;
+
+StreamCore::CompiledProtocol::
+CompiledProtocol(const StreamBuffer& key) : key(key)
+{
+    next = NULL;
+    refcount = 0;
+    reusable = false;
+}
+
+size_t StreamCore::CompiledProtocol::
+size() const
+{
+    return sizeof(CompiledProtocol) + key.length()
+        + inTerminator.length() + outTerminator.length()
+        + separator.length() + commands.length() + onInit.length()
+        + onWriteTimeout.length() + onReplyTimeout.length()
+        + onReadTimeout.length() + onMismatch.length();
+}
+
+void StreamCore::
+flushProtocolCache()
+{
+    // Protocol files may have changed. Streams still using old
+    // compiled protocols keep them until they re-parse or die.
+    CompiledProtocol* p;
+    for (p = CompiledProtocol::first; p; p = p->next)
+        p->reusable = false;
+}
+
+void StreamCore::
+printProtocolCache(FILE* file)
+{
+    unsigned long n = 0, refs = 0;
+    size_t bytes = 0;
+    CompiledProtocol* p;
+    for (p = CompiledProtocol::first; p; p = p->next)
+    {
+        n++;
+        refs += p->refcount;
+        bytes += p->size();
+    }
+    fprintf(file, "  protocol cache: %lu compiled protocol%s (%" Z "u bytes)"
+        " used by %lu record%s\n",
+        n, n == 1 ? "" : "s", bytes, refs, refs == 1 ? "" : "s");
+    fprintf(file, "  protocol cache: %lu hit%s, %" Z "u bytes saved\n",
+        CompiledProtocol::hits, CompiledProtocol::hits == 1 ? "" : "s",
+        CompiledProtocol::bytesSaved);
+}
 
 StreamCore::
 StreamCore() : activeCommand(end)
 {
     businterface = NULL;
+    compiled = NULL;
     flags = None;
     next = NULL;
     unparsedInput = false;
@@ -139,6 +217,7 @@ StreamCore::
 {
     debug("~StreamCore(%s) %p\n", name(), (void*)this);
     releaseBus();
+    releaseProtocol();
     // remove myself from list of all streams
     StreamCore** pstream;
     for (pstream = &first; *pstream; pstream = &(*pstream)->next)
@@ -226,76 +305,391 @@ parse(const char* filename, const char* _protocolname)
             protocolname.truncate(-1); // remove trailing space
         debug("StreamCore::parse \"%s\" -> \"%s\"\n", _protocolname, protocolname.expand()());
     }
-    StreamProtocolParser::Protocol* protocol;
-    protocol = StreamProtocolParser::getProtocol(filename, protocolname);
-    if (!protocol)
+    releaseProtocol();
+
+    // Records using the same protocol with the same parameters from the
+    // same file share the compiled protocol. Only field addresses differ.
+    // The event command compiles only if the bus supports events.
+    StreamBuffer key(filename);
+    key.append('\0').append(protocolname).append('\0');
+    key.append(busSupportsEvent() ? 'e' : '-');
+    CompiledProtocol* p;
+    for (p = CompiledProtocol::first; p; p = p->next)
     {
-        error("while reading protocol '%s' for '%s'\n", protocolname(), name());
-        return false;
+        if (p->reusable && p->key.length() == key.length() &&
+            p->key.startswith(key(), key.length()))
+            break;
+    }
+    if (p)
+    {
+        debug("StreamCore::parse(%s): sharing compiled protocol '%s' with %lu other record%s\n",
+            name(), protocolname.expand()(), p->refcount, p->refcount == 1 ? "" : "s");
+        CompiledProtocol::hits++;
+        CompiledProtocol::bytesSaved += p->size();
     }
-    if (!compile(protocol))
+    else
     {
+        StreamProtocolParser::Protocol* protocol;
+        protocol = StreamProtocolParser::getProtocol(filename, protocolname);
+        if (!protocol)
+        {
+            error("while reading protocol '%s' for '%s'\n", protocolname(), name());
+            return false;
+        }
+        p = new CompiledProtocol(key);
+        if (!compile(protocol, p))
+        {
+            delete p;
+            delete protocol;
+            error("while compiling protocol '%s' for '%s'\n", _protocolname, name());
+            return false;
+        }
         delete protocol;
+        p->next = CompiledProtocol::first;
+        CompiledProtocol::first = p;
+        p->reusable = true;
+    }
+    p->refcount++;
+    compiled = p;
+
+    flags &= ~IgnoreExtraInput;
+    if (p->ignoreExtraInput) flags |= IgnoreExtraInput;
+    lockTimeout = p->lockTimeout;
+    writeTimeout = p->writeTimeout;
+    replyTimeout = p->replyTimeout;
+    readTimeout = p->readTimeout;
+    pollPeriod = p->pollPeriod;
+    maxInput = p->maxInput;
+
+    if (!(resolveFieldAddresses(p->commands()) &&
+        resolveFieldAddresses(p->onInit()) &&
+        resolveFieldAddresses(p->onWriteTimeout()) &&
+        resolveFieldAddresses(p->onReplyTimeout()) &&
+        resolveFieldAddresses(p->onReadTimeout()) &&
+        resolveFieldAddresses(p->onMismatch())))
+    {
+        releaseProtocol();
         error("while compiling protocol '%s' for '%s'\n", _protocolname, name());
         return false;
     }
-    delete protocol;
     return true;
 }
 
 bool StreamCore::
-compile(StreamProtocolParser::Protocol* protocol)
+compile(StreamProtocolParser::Protocol* protocol, CompiledProtocol* p)
 {
     const char* extraInputNames [] = {"error", "ignore", NULL};
 
     // default values for protocol variables
-    flags &= ~IgnoreExtraInput;
-    lockTimeout = 5000;
-    readTimeout = 100;
-    replyTimeout = 1000;
-    writeTimeout = 100;
-    maxInput = 0;
-    pollPeriod = 1000;
-    inTerminatorDefined = false;
-    outTerminatorDefined = false;
+    p->lockTimeout = 5000;
+    p->readTimeout = 100;
+    p->replyTimeout = 1000;
+    p->writeTimeout = 100;
+    p->maxInput = 0;
+    p->pollPeriod = 1000;
+    p->inTerminatorDefined = false;
+    p->outTerminatorDefined = false;
 
     unsigned short ignoreExtraInput = false;
     if (!protocol->getEnumVariable("extrainput", ignoreExtraInput,
         extraInputNames))
         return false;
 
-    if (ignoreExtraInput) flags |= IgnoreExtraInput;
+    p->ignoreExtraInput = ignoreExtraInput;
 
-    if (!(protocol->getNumberVariable("locktimeout", lockTimeout) &&
-        protocol->getNumberVariable("readtimeout", readTimeout) &&
-        protocol->getNumberVariable("replytimeout", replyTimeout) &&
-        protocol->getNumberVariable("writetimeout", writeTimeout) &&
-        protocol->getNumberVariable("maxinput", maxInput) &&
+    if (!(protocol->getNumberVariable("locktimeout", p->lockTimeout) &&
+        protocol->getNumberVariable("readtimeout", p->readTimeout) &&
+        protocol->getNumberVariable("replytimeout", p->replyTimeout) &&
+        protocol->getNumberVariable("writetimeout", p->writeTimeout) &&
+        protocol->getNumberVariable("maxinput", p->maxInput) &&
         // use replyTimeout as default for pollPeriod
-        protocol->getNumberVariable("replytimeout", pollPeriod) &&
-        protocol->getNumberVariable("pollperiod", pollPeriod)))
+        protocol->getNumberVariable("replytimeout", p->pollPeriod) &&
+        protocol->getNumberVariable("pollperiod", p->pollPeriod)))
         return false;
 
-    if (!(protocol->getStringVariable("interminator", inTerminator, &inTerminatorDefined) &&
-        protocol->getStringVariable("outterminator", outTerminator, &outTerminatorDefined) &&
-        (inTerminatorDefined ||
-            protocol->getStringVariable("terminator", inTerminator, &inTerminatorDefined)) &&
-        (outTerminatorDefined ||
-            protocol->getStringVariable("terminator", outTerminator, &outTerminatorDefined)) &&
-        protocol->getStringVariable("separator", separator)))
+    if (!(protocol->getStringVariable("interminator", p->inTerminator, &p->inTerminatorDefined) &&
+        protocol->getStringVariable("outterminator", p->outTerminator, &p->outTerminatorDefined) &&
+        (p->inTerminatorDefined ||
+            protocol->getStringVariable("terminator", p->inTerminator, &p->inTerminatorDefined)) &&
+        (p->outTerminatorDefined ||
+            protocol->getStringVariable("terminator", p->outTerminator, &p->outTerminatorDefined)) &&
+        protocol->getStringVariable("separator", p->separator)))
         return false;
 
-    if (!(protocol->getCommands(NULL, commands, this) &&
-        protocol->getCommands("@init", onInit, this) &&
-        protocol->getCommands("@writetimeout", onWriteTimeout, this) &&
-        protocol->getCommands("@replytimeout", onReplyTimeout, this) &&
-        protocol->getCommands("@readtimeout", onReadTimeout, this) &&
-        protocol->getCommands("@mismatch", onMismatch, this)))
+    if (!(protocol->getCommands(NULL, p->commands, this) &&
+        protocol->getCommands("@init", p->onInit, this) &&
+        protocol->getCommands("@writetimeout", p->onWriteTimeout, this) &&
+        protocol->getCommands("@replytimeout", p->onReplyTimeout, this) &&
+        protocol->getCommands("@readtimeout", p->onReadTimeout, this) &&
+        protocol->getCommands("@mismatch", p->onMismatch, this)))
         return false;
 
+    optimizeCommands(p->commands);
+    optimizeCommands(p->onInit);
+    optimizeCommands(p->onWriteTimeout);
+    optimizeCommands(p->onReplyTimeout);
+    optimizeCommands(p->onReadTimeout);
+    optimizeCommands(p->onMismatch);
+
     return protocol->checkUnused();
 }
 
+static void appendLiteral(StreamBuffer& code, const StreamBuffer& run)
+{
+    // <literal> length bytes
+    size_t i, len;
+    for (i = 0; i < run.length(); i += len)
+    {
+        len = run.length() - i;
+        if (len > 0xffff) len = 0xffff;
+        unsigned short l = (unsigned short)len;
+        code.append(StreamProtocolParser::literal);
+        code.append(&l, sizeof(l));
+        code.append(run(i), len);
+    }
+}
+
+void StreamCore::
+optimizeCommands(StreamBuffer& commands)
+{
+    // Fold literal bytes of in, out and exec strings into runs
+    // which can be compared with memcmp or appended at once.
+    // Prefix in strings with the minimum input length, which is
+    // the number of literal bytes, to reject short input early.
+    // Pseudo formats like regsub may change the input, thus only
+    // literals before the first pseudo format count and a flag
+    // tells that the input may be shorter.
+    StreamBuffer code;
+    StreamBuffer run;
+    const char* c = commands();
+    const char* f;
+    char command;
+
+    if (!commands) return;
+    while (1)
+    {
+        switch (command = *c++)
+        {
+            case end:
+                code.append(command);
+                commands.swap(code);
+                return;
+            case in:
+            case out:
+            case exec:
+            {
+                size_t minlength = 0;
+                size_t minpos = 0;
+                bool pseudo = false;
+                code.append(command);
+                if (command == in)
+                {
+                    // <min_length> length pseudo
+                    unsigned short l = 0;
+                    minpos = code.length();
+                    code.append(StreamProtocolParser::min_length);
+                    code.append(&l, sizeof(l));
+                    code.append('\0');
+                }
+                while (*c != StreamProtocolParser::eos)
+                {
+                    switch (*c)
+                    {
+                        case StreamProtocolParser::format_field:
+                        case StreamProtocolParser::format:
+                        {
+                            appendLiteral(code, run);
+                            run.clear();
+                            f = c++;
+                            if (*f == StreamProtocolParser::format_field)
+                            {
+                                // field <eos> addrlen AddressStructure
+                                c += strlen(c)+1;
+                                unsigned short addrlen = extract<unsigned short>(c);
+                                c += addrlen;
+                            }
+                            // formatstring <eos> StreamFormat [info]
+                            c = skipFormatString(c);
+                            StreamFormat fmt = extract<StreamFormat>(c);
+                            c += fmt.infolen;
+                            if (fmt.type == pseudo_format) pseudo = true;
+                            code.append(f, c-f);
+                            continue;
+                        }
+                        case StreamProtocolParser::skip:
+                        case StreamProtocolParser::whitespace:
+                            appendLiteral(code, run);
+                            run.clear();
+                            code.append(*c++);
+                            continue;
+                        case esc:
+                            // escaped literal byte
+                            c++;
+                        default:
+                            // literal byte
+                            run.append(*c++);
+                            if (!pseudo) minlength++;
+                    }
+                }
+                appendLiteral(code, run);
+                run.clear();
+                code.append(*c++);
+                if (command == in)
+                {
+                    if (minlength > 0xffff) minlength = 0xffff;
+                    unsigned short l = (unsigned short)minlength;
+                    if (l || pseudo)
+                    {
+                        memcpy(code(minpos + 1), &l, sizeof(l));
+                        code[minpos + 1 + sizeof(l)] = pseudo;
+                    }
+                    else
+                        code.remove((ssize_t)minpos, (ssize_t)(2 + sizeof(l)));
+                }
+                break;
+            }
+            case wait:
+            case connect:
+                code.append(command);
+                code.append(c, sizeof(unsigned long));
+                c += sizeof(unsigned long);
+                break;
+            case event:
+                code.append(command);
+                code.append(c, 2*sizeof(unsigned long));
+                c += 2*sizeof(unsigned long);
+                break;
+            case disconnect:
+                code.append(command);
+                break;
+            default:
+                error("INTERNAL ERROR (%s): illegal command code 0x%02x\n",
+                    name(), c[-1]);
+                return;
+        }
+    }
+}
+
+void StreamCore::
+releaseProtocol()
+{
+    fieldAddresses.clear();
+    if (!compiled) return;
+    CompiledProtocol* p = const_cast<CompiledProtocol*>(compiled);
+    compiled = NULL;
+    if (--p->refcount) return;
+    CompiledProtocol** pp;
+    for (pp = &CompiledProtocol::first; *pp; pp = &(*pp)->next)
+    {
+        if (*pp == p)
+        {
+            *pp = p->next;
+            break;
+        }
+    }
+    delete p;
+}
+
+bool StreamCore::
+resolveFieldAddresses(const char* c)
+{
+    // Walk through the compiled commands and get the address of each
+    // redirected field for this stream.
+    // Table layout: fieldname pointer, addrlen, AddressStructure
+    if (!c) return true;
+    while (1)
+    {
+        switch (*c++)
+        {
+            case end:
+                return true;
+            case in:
+            case out:
+            case exec:
+                while (*c != StreamProtocolParser::eos)
+                {
+                    switch (*c++)
+                    {
+                        case StreamProtocolParser::format_field:
+                        {
+                            // field <eos> addrlen AddressStructure formatstring <eos> StreamFormat [info]
+                            const char* fieldname = c;
+                            c += strlen(c)+1;
+                            unsigned short addrlen = extract<unsigned short>(c);
+                            c += addrlen;
+                            StreamBuffer address;
+                            if (!getFieldAddress(fieldname, address))
+                            {
+                                error("%s: Field '%s' not found\n",
+                                    name(), fieldname);
+                                return false;
+                            }
+                            addrlen = (unsigned short)address.length();
+                            fieldAddresses.append(&fieldname, sizeof(fieldname));
+                            fieldAddresses.append(&addrlen, sizeof(addrlen));
+                            fieldAddresses.append(address);
+                        }
+                        case StreamProtocolParser::format:
+                        {
+                            // formatstring <eos> StreamFormat [info]
+                            c = skipFormatString(c);
+                            StreamFormat fmt = extract<StreamFormat>(c);
+                            c += fmt.infolen;
+                            break;
+                        }
+                        case StreamProtocolParser::literal:
+                        {
+                            // length bytes
+                            unsigned short len = extract<unsigned short>(c);
+                            c += len;
+                            break;
+                        }
+                        case StreamProtocolParser::min_length:
+                            c += sizeof(unsigned short) + 1;
+                            break;
+                        case esc:
+                            c++;
+                    }
+                }
+                c++;
+                break;
+            case wait:
+            case connect:
+                c += sizeof(unsigned long);
+                break;
+            case event:
+                c += 2*sizeof(unsigned long);
+                break;
+            case disconnect:
+                break;
+            default:
+                error("INTERNAL ERROR (%s): illegal command code 0x%02x\n",
+                    name(), c[-1]);
+                return false;
+        }
+    }
+}
+
+bool StreamCore::
+findFieldAddress(const char* fieldname)
+{
+    const char* p = fieldAddresses();
+    while (p < fieldAddresses.end())
+    {
+        const char* f = extract<const char*>(p);
+        unsigned short addrlen = extract<unsigned short>(p);
+        if (f == fieldname)
+        {
+            fieldAddress.set(p, addrlen);
+            return true;
+        }
+        p += addrlen;
+    }
+    error("INTERNAL ERROR (%s): no address for field '%s'\n",
+        name(), fieldname);
+    return false;
+}
+
 bool StreamCore::
 compileCommand(StreamProtocolParser::Protocol* protocol,
     StreamBuffer& buffer, const char* command, const char*& args)
@@ -431,13 +825,18 @@ startProtocol(StartMode startMode)
         error("%s: No businterface attached\n", name());
         return false;
     }
+    if (!compiled)
+    {
+        error("%s: No protocol loaded\n", name());
+        return false;
+    }
     flags &= ~ClearOnStart;
     switch (startMode)
     {
         case StartInit:
-            if (!onInit) return false;
+            if (!compiled->onInit) return false;
             flags |= InitRun;
-            commandIndex = onInit();
+            commandIndex = compiled->onInit();
             break;
         case StartAsync:
             if (!busSupportsAsyncRead())
@@ -447,8 +846,8 @@ startProtocol(StartMode startMode)
             }
             flags |= AsyncMode;
         case StartNormal:
-            if (!commands) return false;
-            commandIndex = commands();
+            if (!compiled->commands) return false;
+            commandIndex = compiled->commands();
             break;
     }
     StreamBuffer buffer;
@@ -485,23 +884,23 @@ finishProtocol(ProtocolResult status)
         // save original error status
         runningHandler = status;
         // look for error handler
-        char* handler;
+        const char* handler;
         switch (status)
         {
             case Success:
                 handler = NULL;
                 break;
             case WriteTimeout:
-                handler = onWriteTimeout();
+                handler = compiled->onWriteTimeout();
                 break;
             case ReplyTimeout:
-                handler = onReplyTimeout();
+                handler = compiled->onReplyTimeout();
                 break;
             case ReadTimeout:
-                handler = onReadTimeout();
+                handler = compiled->onReadTimeout();
                 break;
             case ScanError:
-                handler = onMismatch();
+                handler = compiled->onMismatch();
                 /* reparse old input if first command in handler is 'in' */
                 if (*handler == in)
                 {
@@ -604,7 +1003,7 @@ evalOut()
         finishProtocol(FormatError);
         return false;
     }
-    outputLine.append(outTerminator);
+    outputLine.append(compiled->outTerminator);
     debug ("StreamCore::evalOut: outputLine = \"%s\"\n", outputLine.expand()());
     if (*commandIndex == in)  // prepare for early input
     {
@@ -659,8 +1058,9 @@ formatOutput()
                 fieldName = commandIndex;
                 commandIndex += strlen(commandIndex)+1;
                 unsigned short addrlen = extract<unsigned short>(commandIndex);
-                fieldAddress.set(commandIndex, addrlen);
                 commandIndex += addrlen;
+                // use our own address, the code may be shared with other streams
+                if (!findFieldAddress(fieldName)) return false;
                 goto normal_format;
             }
             case StreamProtocolParser::format:
@@ -670,14 +1070,8 @@ normal_format:
                 // code layout:
                 // formatstring <eos> StreamFormat [info]
                 formatstring = commandIndex;
-                // jump after <eos>
-                while (*commandIndex)
-                {
-                    if (*commandIndex == esc) commandIndex++;
-                    commandIndex++;
-                }
-                formatstringlen = commandIndex-formatstring;
-                commandIndex++;
+                commandIndex = skipFormatString(commandIndex);
+                formatstringlen = commandIndex-formatstring-1;
 
                 StreamFormat fmt = extract<StreamFormat>(commandIndex);
                 fmt.info = commandIndex; // point to info string
@@ -710,6 +1104,14 @@ normal_format:
                 }
                 continue;
             }
+            case StreamProtocolParser::literal:
+            {
+                // literal bytes
+                unsigned short len = extract<unsigned short>(commandIndex);
+                outputLine.append(commandIndex, len);
+                commandIndex += len;
+                continue;
+            }
             case StreamProtocolParser::whitespace:
                 outputLine.append(' ');
             case StreamProtocolParser::skip:
@@ -733,11 +1135,11 @@ printSeparator()
         flags |= Separator;
         return;
     }
-    if (!separator) return;
+    if (!compiled->separator) return;
     size_t i = 0;
-    for (; i < separator.length(); i++)
+    for (; i < compiled->separator.length(); i++)
     {
-        switch (separator[i])
+        switch (compiled->separator[i])
         {
             case StreamProtocolParser::whitespace:
                 outputLine.append(' '); // print single space
@@ -748,7 +1150,7 @@ printSeparator()
                 i++;
             default:
                 // literal byte
-                outputLine.append(separator[i]);
+                outputLine.append(compiled->separator[i]);
         }
     }
 }
@@ -890,10 +1292,10 @@ writeCallback(StreamIoStatus status)
 const char* StreamCore::
 getOutTerminator(size_t& length)
 {
-    if (outTerminatorDefined)
+    if (compiled && compiled->outTerminatorDefined)
     {
-        length = outTerminator.length();
-        return outTerminator();
+        length = compiled->outTerminator.length();
+        return compiled->outTerminator();
     }
     else
     {
@@ -973,7 +1375,7 @@ readCallback(StreamIoStatus status,
         case StreamIoTimeout:
             // timeout is valid end if we have no terminator
             // and number of input bytes is not limited
-            if (!inTerminator && !maxInput)
+            if (!compiled->inTerminator && !maxInput)
             {
                 status = StreamIoEnd;
             }
@@ -1021,7 +1423,7 @@ readCallback(StreamIoStatus status,
     ssize_t end = -1;
     size_t termlen = 0;
 
-    if (inTerminator)
+    if (compiled->inTerminator)
     {
         // look for terminator
         // performance issue for long inputs that come in chunks:
@@ -1041,18 +1443,18 @@ readCallback(StreamIoStatus status,
             // already parsed chunks in inputBuffer
             // start parsing at beginning of new data
             // but beware of split terminators
-            start = inputBuffer.length() - size - inTerminator.length();
+            start = inputBuffer.length() - size - compiled->inTerminator.length();
             if (start < 0) start = 0;
         }
-        end = inputBuffer.find(inTerminator, start);
+        end = inputBuffer.find(compiled->inTerminator, start);
         if (end >= 0)
         {
-            termlen = inTerminator.length();
+            termlen = compiled->inTerminator.length();
             debug("StreamCore::readCallback(%s) inTerminator %s at position %" Z "u\n",
-                name(), inTerminator.expand()(), end);
+                name(), compiled->inTerminator.expand()(), end);
         } else {
             debug("StreamCore::readCallback(%s) inTerminator %s not found\n",
-                name(), inTerminator.expand()());
+                name(), compiled->inTerminator.expand()());
         }
     }
     if (status == StreamIoEnd && end < 0)
@@ -1115,11 +1517,14 @@ readCallback(StreamIoStatus status,
         }
     }
 
-    inputLine.set(inputBuffer(), end);
+    // take the line from inputBuffer without copying it,
+    // only unparsed input behind the line is copied back
+    inputLine.swap(inputBuffer);
+    inputBuffer.set(inputLine(end + termlen), inputLine.length() - end - termlen);
+    inputLine.truncate(end);
     debug("StreamCore::readCallback(%s) input line: \"%s\"\n",
         name(), inputLine.expand()());
     bool matches = matchInput();
-    inputBuffer.remove(end + termlen);
     if (inputBuffer)
     {
         debug("StreamCore::readCallback(%s) unpared input left: \"%s\"\n",
@@ -1173,6 +1578,7 @@ matchInput()
     */
     char command;
     const char* fieldName = NULL;
+    const char* formatsource;
     StreamBuffer formatstring;
 
     consumedInput = 0;
@@ -1188,8 +1594,9 @@ matchInput()
                 fieldName = commandIndex;
                 commandIndex += strlen(commandIndex)+1;
                 unsigned short addrlen = extract<unsigned short>(commandIndex);
-                fieldAddress.set(commandIndex, addrlen);
                 commandIndex += addrlen;
+                // use our own address, the code may be shared with other streams
+                if (!findFieldAddress(fieldName)) return false;
                 goto normal_format;
             }
             case StreamProtocolParser::format:
@@ -1199,14 +1606,14 @@ normal_format:
                 ssize_t consumed;
                 // code layout:
                 // formatstring <eos> StreamFormat [info]
-                formatstring.clear();
-                commandIndex = StreamProtocolParser::printString(formatstring, commandIndex);
+                formatsource = commandIndex;
+                commandIndex = skipFormatString(commandIndex);
 
                 StreamFormat fmt = extract<StreamFormat>(commandIndex);
                 fmt.info = commandIndex; // point to info string
                 commandIndex += fmt.infolen;
                 debug("StreamCore::matchInput(%s): format = \"%%%s\"\n",
-                    name(), formatstring());
+                    name(), formatString(formatstring, formatsource));
 
                 if (fmt.flags & skip_flag || fmt.type == pseudo_format)
                 {
@@ -1247,12 +1654,12 @@ normal_format:
                         }
                         else
                         {
-                            if (!(flags & AsyncMode) && onMismatch[0] != in)
+                            if (!(flags & AsyncMode) && compiled->onMismatch[0] != in)
                             {
                                 error("%s: Input \"%s%s\" does not match format \"%%%s\"\n",
                                     name(), inputLine.expand(consumedInput, 20)(),
                                     inputLine.length()-consumedInput > 20 ? "..." : "",
-                                    formatstring());
+                                    formatString(formatstring, formatsource));
                             }
                             return false;
                         }
@@ -1268,10 +1675,10 @@ normal_format:
                     {
                         if (fieldAddress)
                             error("%s: Cannot format variable \"%s\" with \"%%%s\"\n",
-                                name(), fieldName, formatstring());
+                                name(), fieldName, formatString(formatstring, formatsource));
                         else
                             error("%s: Cannot format value with \"%%%s\"\n",
-                                name(), formatstring());
+                                name(), formatString(formatstring, formatsource));
                         return false;
                     }
                     debug("StreamCore::matchInput(%s): compare \"%s\" with \"%s\"\n",
@@ -1279,26 +1686,26 @@ normal_format:
                             outputLine.length())(), outputLine.expand()());
                     if (inputLine.length() - consumedInput < outputLine.length())
                     {
-                        if (!(flags & AsyncMode) && onMismatch[0] != in)
+                        if (!(flags & AsyncMode) && compiled->onMismatch[0] != in)
                         {
                             error("%s: Input \"%s%s\" too short."
                                   " No match for format \"%%%s\" (\"%s\")\n",
                                 name(),
                                 inputLine.length() > 20 ? "..." : "",
                                 inputLine.expand(-20)(),
-                                formatstring(),
+                                formatString(formatstring, formatsource),
                                 outputLine.expand()());
                         }
                         return false;
                     }
                     if (!outputLine.startswith(inputLine(consumedInput),outputLine.length()))
                     {
-                        if (!(flags & AsyncMode) && onMismatch[0] != in)
+                        if (!(flags & AsyncMode) && compiled->onMismatch[0] != in)
                         {
                             error("%s: Input \"%s%s\" does not match format \"%%%s\" (\"%s\")\n",
                                 name(), inputLine.expand(consumedInput, 20)(),
                                 inputLine.length()-consumedInput > 20 ? "..." : "",
-                                formatstring(),
+                                formatString(formatstring, formatsource),
                                 outputLine.expand()());
                         }
                         return false;
@@ -1309,22 +1716,94 @@ normal_format:
                 flags &= ~Separator;
                 if (!matchValue(fmt, fieldAddress ? fieldAddress() : NULL))
                 {
-                    if (!(flags & AsyncMode) && onMismatch[0] != in)
+                    if (!(flags & AsyncMode) && compiled->onMismatch[0] != in)
                     {
                         if (flags & ScanTried)
                             error("%s: Input \"%s%s\" does not match format \"%%%s\"\n",
                                 name(), inputLine.expand(consumedInput, 20)(),
                                 inputLine.length()-consumedInput > 20 ? "..." : "",
-                                formatstring());
+                                formatString(formatstring, formatsource));
                         else
                             error("%s: Format \"%%%s\" has data type %s which is not supported by \"%s\".\n",
-                                name(), formatstring(), StreamFormatTypeStr[fmt.type], fieldAddress ? fieldName : name());
+                                name(), formatString(formatstring, formatsource), StreamFormatTypeStr[fmt.type], fieldAddress ? fieldName : name());
                     }
                     return false;
                 }
                 // matchValue() has already removed consumed bytes from inputBuffer
                 break;
             }
+            case StreamProtocolParser::min_length:
+            {
+                // input needs at least as many bytes as literals
+                unsigned short len = extract<unsigned short>(commandIndex);
+                commandIndex++; // pseudo flag
+                if (inputLine.length() < len)
+                {
+                    if (!(flags & AsyncMode) && compiled->onMismatch[0] != in)
+                    {
+                        error("%s: Input \"%s%s\" too short.\n",
+                            name(),
+                            inputLine.length() > 20 ? "..." : "",
+                            inputLine.expand(-20)());
+                        error("%s: Expected at least %u bytes but got %" Z "u\n",
+                            name(), len, inputLine.length());
+                    }
+                    return false;
+                }
+                break;
+            }
+            case StreamProtocolParser::literal:
+            {
+                // run of literal bytes
+                unsigned short len = extract<unsigned short>(commandIndex);
+                size_t avail = inputLine.length() - consumedInput;
+                if (avail >= len &&
+                    memcmp(inputLine(consumedInput), commandIndex, len) == 0)
+                {
+                    consumedInput += len;
+                    commandIndex += len;
+                    break;
+                }
+                // find where the mismatch is
+                size_t i = 0;
+                while (i < len && i < avail && inputLine[consumedInput+i] == commandIndex[i]) i++;
+                consumedInput += i;
+                if (!(flags & AsyncMode) && compiled->onMismatch[0] != in)
+                {
+                    if (i == avail)
+                    {
+                        error("%s: Input \"%s%s\" too short.\n",
+                            name(),
+                            inputLine.length() > 20 ? "..." : "",
+                            inputLine.expand(-20)());
+                        error("No match for \"%s\"\n",
+                            StreamBuffer(commandIndex+i, len-i).expand()());
+                    }
+                    else
+                    {
+                        error("%s: Input \"%s%s%s\"\n",
+                            name(),
+                            consumedInput > 20 ? "..." : "",
+                            inputLine.expand(consumedInput > 20 ? consumedInput-20 : 0, 40)(),
+                            inputLine.length() - consumedInput > 20 ? "..." : "");
+
+                        error("%s: mismatch after %" Z "d byte%s \"%s%s\"\n",
+                            name(),
+                            consumedInput,
+                            consumedInput==1 ? "" : "s",
+                            consumedInput > 10 ? "..." : "",
+                            inputLine.expand(consumedInput > 10 ? consumedInput-10 : 0,
+                                consumedInput > 10 ? 10 : consumedInput)());
+
+                        error("%s: got \"%s%s\" where \"%s\" was expected\n",
+                            name(),
+                            inputLine.expand(consumedInput, 10)(),
+                            inputLine.length() - consumedInput > 10 ? "..." : "",
+                            StreamBuffer(commandIndex+i, len-i).expand()());
+                    }
+                }
+                return false;
+            }
             case StreamProtocolParser::skip:
                 // ignore next input byte (if exists)
                 if (consumedInput < inputLine.length()) consumedInput++;
@@ -1342,7 +1821,7 @@ normal_format:
                 {
                     int i = 0;
                     while (commandIndex[i] >= ' ') i++;
-                    if (!(flags & AsyncMode) && onMismatch[0] != in)
+                    if (!(flags & AsyncMode) && compiled->onMismatch[0] != in)
                     {
                         error("%s: Input \"%s%s\" too short.\n",
                             name(),
@@ -1355,7 +1834,7 @@ normal_format:
                 }
                 if (command != inputLine[consumedInput])
                 {
-                    if (!(flags & AsyncMode) && onMismatch[0] != in)
+                    if (!(flags & AsyncMode) && compiled->onMismatch[0] != in)
                     {
                         int i = 0;
                         while (commandIndex[i] >= ' ') i++;
@@ -1387,7 +1866,7 @@ normal_format:
     size_t surplus = inputLine.length()-consumedInput;
     if (surplus > 0 && !(flags & IgnoreExtraInput))
     {
-        if (!(flags & AsyncMode) && onMismatch[0] != in)
+        if (!(flags & AsyncMode) && compiled->onMismatch[0] != in)
         {
             error("%s: %" Z "d byte%s surplus input \"%s%s\"\n",
                 name(), surplus, surplus==1 ? "" : "s",
@@ -1416,7 +1895,7 @@ matchSeparator()
     // called before value is read, first value has Separator flag cleared
     // for second and next value set Separator flag
 
-    if (!separator) {
+    if (!compiled->separator) {
         // empty separator matches
         return true;
     }
@@ -1428,9 +1907,9 @@ matchSeparator()
     }
     size_t i;
     size_t j = consumedInput;
-    for (i = 0; i < separator.length(); i++)
+    for (i = 0; i < compiled->separator.length(); i++)
     {
-        switch (separator[i])
+        switch (compiled->separator[i])
         {
             case StreamProtocolParser::skip:
                 j++;
@@ -1441,12 +1920,12 @@ matchSeparator()
             case esc:
                 i++;
             default:
-                if (separator[i] != inputLine[j])
+                if (compiled->separator[i] != inputLine[j])
                 {
                     // no match
                     // don't complain here, just return false
                     debug("StreamCore::matchSeparator(%s) separator \"%s\" not found\n",
-                        name(), separator.expand()());
+                        name(), compiled->separator.expand()());
                     return false;
                 }
                 j++;
@@ -1454,7 +1933,7 @@ matchSeparator()
     }
     // separator successfully read
     debug("StreamCore::matchSeparator(%s) separator \"%s\" found\n",
-        name(), separator.expand()());
+        name(), compiled->separator.expand()());
     consumedInput = j;
     return true;
 }
@@ -1556,13 +2035,32 @@ scanValue(const StreamFormat& fmt, char* value, size_t& size)
     return consumed;
 }
 
+ssize_t StreamCore::
+scanArray(const StreamFormat& fmt, void* values, size_t size, size_t& count)
+{
+    // Bulk scan of up to count elements with size bytes each.
+    // Only possible without separator and if the converter supports it.
+    // Returns -1 if not possible, else the number of consumed bytes.
+    if (compiled->separator || fmt.flags & (default_flag|fix_width_flag))
+        return -1;
+    ssize_t consumed = StreamFormatConverter::find(fmt.conv)->
+        scanArray(fmt, inputLine(consumedInput),
+            inputLine.length()-consumedInput, values, size, count);
+    if (consumed < 0) return -1;
+    flags |= ScanTried;
+    debug("StreamCore::scanArray(%s, format=%%%c, size=%" Z "u) %" Z "u elements from %" Z "d bytes\n",
+        name(), fmt.conv, size, count, consumed);
+    if (count) flags |= GotValue;
+    return consumed;
+}
+
 const char* StreamCore::
 getInTerminator(size_t& length)
 {
-    if (inTerminatorDefined)
+    if (compiled && compiled->inTerminatorDefined)
     {
-        length = inTerminator.length();
-        return inTerminator();
+        length = compiled->inTerminator.length();
+        return compiled->inTerminator();
     }
     else
     {
@@ -1571,6 +2069,52 @@ getInTerminator(size_t& length)
     }
 }
 
+const char* StreamCore::
+getInPrefix(size_t& length)
+{
+    // constant bytes at the start of the active in command
+    const char* c = commandIndex;
+    if (activeCommand == in && c)
+    {
+        if (*c == StreamProtocolParser::min_length)
+            c += 2 + sizeof(unsigned short);
+        if (*c == StreamProtocolParser::literal)
+        {
+            c++;
+            length = extract<unsigned short>(c);
+            return c;
+        }
+    }
+    length = 0;
+    return NULL;
+}
+
+size_t StreamCore::
+getInMinLength(bool& pseudo)
+{
+    // number of constant bytes in the active in command
+    // pseudo is set if pseudo formats may change the input
+    const char* c = commandIndex;
+    if (activeCommand == in && c &&
+        *c == StreamProtocolParser::min_length)
+    {
+        c++;
+        size_t length = extract<unsigned short>(c);
+        pseudo = *c != 0;
+        return length;
+    }
+    pseudo = false;
+    return 0;
+}
+
+const void* StreamCore::
+getInCommand()
+{
+    // identifies the active in command, NULL if there is none
+    if (activeCommand != in) return NULL;
+    return commandIndex;
+}
+
 // Handle 'event' command
 
 bool StreamCore::
@@ -145,6 +145,46 @@ protected:
     ssize_t scanValue(const StreamFormat& format, double& value);
     ssize_t scanValue(const StreamFormat& format, char* value, size_t& size);
     ssize_t scanValue(const StreamFormat& format);
+    ssize_t scanArray(const StreamFormat& format,
+        void* values, size_t size, size_t& count);
+
+    // The compiled protocol is immutable and shared by all streams
+    // which use the same protocol with the same parameters from the
+    // same file. Field addresses are stored per stream in fieldAddresses.
+    class CompiledProtocol
+    {
+        friend class StreamCore;
+        CompiledProtocol* next;
+        static CompiledProtocol* first;
+        static unsigned long hits;
+        static size_t bytesSaved;
+        StreamBuffer key;
+        unsigned long refcount;
+        bool reusable;
+
+        CompiledProtocol(const StreamBuffer& key);
+        size_t size() const;
+
+    public:
+        bool ignoreExtraInput;
+        unsigned long lockTimeout;
+        unsigned long writeTimeout;
+        unsigned long replyTimeout;
+        unsigned long readTimeout;
+        unsigned long pollPeriod;
+        unsigned long maxInput;
+        bool inTerminatorDefined;
+        bool outTerminatorDefined;
+        StreamBuffer inTerminator;
+        StreamBuffer outTerminator;
+        StreamBuffer separator;
+        StreamBuffer commands;        // the normal protocol
+        StreamBuffer onInit;          // init protocol (optional)
+        StreamBuffer onWriteTimeout;  // error handler (optional)
+        StreamBuffer onReplyTimeout;  // error handler (optional)
+        StreamBuffer onReadTimeout;   // error handler (optional)
+        StreamBuffer onMismatch;      // error handler (optional)
+    };
 
     StreamBuffer protocolname;
     unsigned long lockTimeout;
@@ -153,17 +193,8 @@ protected:
     unsigned long readTimeout;
     unsigned long pollPeriod;
     unsigned long maxInput;
-    bool inTerminatorDefined;
-    bool outTerminatorDefined;
-    StreamBuffer inTerminator;
-    StreamBuffer outTerminator;
-    StreamBuffer separator;
-    StreamBuffer commands;        // the normal protocol
-    StreamBuffer onInit;          // init protocol (optional)
-    StreamBuffer onWriteTimeout;  // error handler (optional)
-    StreamBuffer onReplyTimeout;  // error handler (optional)
-    StreamBuffer onReadTimeout;   // error handler (optional)
-    StreamBuffer onMismatch;      // error handler (optional)
+    const CompiledProtocol* compiled;
+    StreamBuffer fieldAddresses;  // fieldname pointer, addrlen, address
     const char* commandIndex;     // current position
     char activeCommand;           // current command
     StreamBuffer outputLine;
@@ -177,7 +208,11 @@ protected:
     bool unparsedInput;
 
     StreamCore(const StreamCore&); // undefined
-    bool compile(StreamProtocolParser::Protocol*);
+    bool compile(StreamProtocolParser::Protocol*, CompiledProtocol*);
+    void optimizeCommands(StreamBuffer& commands);
+    void releaseProtocol();
+    bool resolveFieldAddresses(const char* commands);
+    bool findFieldAddress(const char* fieldname);
     bool evalCommand();
     bool evalOut();
     bool evalIn();
@@ -208,6 +243,9 @@ protected:
     void disconnectCallback(StreamIoStatus status);
     const char* getInTerminator(size_t& length);
     const char* getOutTerminator(size_t& length);
+    const char* getInPrefix(size_t& length);
+    size_t getInMinLength(bool& pseudo);
+    const void* getInCommand();
 
 // virtual methods
     virtual void protocolStartHook() {}
@@ -225,8 +263,12 @@ public:
     bool parse(const char* filename, const char* protocolname);
     void printProtocol(FILE* = stdout);
     const char* name() { return streamname; }
+    const char* busName()
+        { return businterface ? businterface->name() : NULL; }
     void printStatus(StreamBuffer& buffer);
     static const char* license(void);
+    static void flushProtocolCache();
+    static void printProtocolCache(FILE* = stdout);
 
 private:
     char* printCommands(StreamBuffer& buffer, const char* c);
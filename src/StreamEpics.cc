@@ -122,10 +122,14 @@ class Stream : protected StreamCore
     epicsTimer* timer;
     epicsMutex mutex;
     epicsEvent initDone;
+    bool initPending;
+    epicsTime initStart;
+    epicsTime initEnd;
 #endif
     int status;
     int convert;
     ssize_t currentValueLength;
+    StreamBuffer fieldBuffer; // scratch buffer for redirected formats
     IOSCANPVT ioscanpvt;
     CALLBACK commandCallback;
     CALLBACK processCallback;
@@ -168,7 +172,17 @@ class Stream : protected StreamCore
     ~Stream();
     long initRecord(char* linkstring);
     bool print(format_t *format, va_list ap);
+    bool printArray(format_t *format, const void* buffer,
+        unsigned short type, size_t nelm);
+    template<class T>
+    bool printLongElements(const StreamFormat& fmt, const T* buffer, size_t nelm);
+    template<class T>
+    bool printDoubleElements(const StreamFormat& fmt, const T* buffer, size_t nelm);
     ssize_t scan(format_t *format, void* pvalue, size_t maxStringSize);
+    ssize_t scanArray(format_t *format, void* buffer,
+        unsigned short type, size_t nelm);
+    template<class V, class T>
+    size_t scanElements(const StreamFormat& fmt, T* buffer, size_t nelm);
     bool process();
 
 #ifdef WITH_IOC_RUN
@@ -182,8 +196,12 @@ class Stream : protected StreamCore
     friend long streamGetIointInfo(int cmd, dbCommon *record,
         IOSCANPVT *ppvt);
     friend long streamPrintf(dbCommon *record, format_t *format, ...);
+    friend long streamPrintArray(dbCommon *record, format_t *format,
+        const void* buffer, unsigned short type, size_t nelm);
     friend ssize_t streamScanfN(dbCommon *record, format_t *format,
         void*, size_t maxStringSize);
+    friend ssize_t streamScanArray(dbCommon *record, format_t *format,
+        void* buffer, unsigned short type, size_t nelm);
     friend long streamReload(const char* recordname);
     friend long streamReportRecord(const char* recordname);
 
@@ -191,13 +209,20 @@ public:
     long priority() { return record->prio; };
     static long report(int interest);
     static long drvInit();
+#ifndef EPICS_3_13
+    static void parallelInit();
+#endif
 };
 
 
 // shell functions ///////////////////////////////////////////////////////
+// run @init handlers of records on different ports in parallel
+int streamParallelInit = 0;
+
 extern "C" { // needed for Windows
 epicsExportAddress(int, streamDebug);
 epicsExportAddress(int, streamError);
+epicsExportAddress(int, streamParallelInit);
 }
 
 // for subroutine record
@@ -219,6 +244,7 @@ long streamReload(const char* recordname)
         return ERROR;
     }
     debug("streamReload(%s)\n", recordname);
+    StreamCore::flushProtocolCache();
     for (stream = static_cast<Stream*>(Stream::first); stream;
         stream = static_cast<Stream*>(stream->next))
     {
@@ -238,6 +264,7 @@ long streamReload(const char* recordname)
             error("%s: Protocol reload failed\n", stream->name());
     }
     StreamProtocolParser::free();
+    StreamCore::flushProtocolCache();
     streamError = oldStreamError;
     return OK;
 }
@@ -387,6 +414,8 @@ report(int interest)
         }
     }
 
+    printProtocolCache(stdout);
+
     Stream* stream;
     printf("  connected records:\n");
     for (stream = static_cast<Stream*>(first); stream;
@@ -442,6 +471,7 @@ long Stream::
 drvInit()
 {
     char* path;
+    char* cachedir;
     debug("drvStreamInit()\n");
     path = getenv("STREAM_PROTOCOL_PATH");
 #if defined(__vxworks) || defined(vxWorks)
@@ -467,6 +497,14 @@ drvInit()
         StreamProtocolParser::path = path;
     debug("StreamProtocolParser::path = %s\n",
         StreamProtocolParser::path);
+    cachedir = getenv("STREAM_PROTOCOL_CACHE");
+    if (cachedir && *cachedir)
+    {
+        StreamProtocolParser::cachedir = cachedir;
+        StreamProtocolParser::cachetag = StreamVersion;
+    }
+    debug("StreamProtocolParser::cachedir = %s\n",
+        StreamProtocolParser::cachedir ? StreamProtocolParser::cachedir : "(none)");
     StreamPrintTimestampFunction = streamEpicsPrintTimestamp;
 
 #ifdef WITH_IOC_RUN
@@ -497,15 +535,116 @@ initHook(initHookState state)
         for (stream = static_cast<Stream*>(first); stream;
             stream = static_cast<Stream*>(stream->next))
         {
-            if (!stream->onInit) continue;
+            if (!stream->compiled || !stream->compiled->onInit) continue;
+            if (streamParallelInit)
+            {
+                stream->initPending = true;
+                continue;
+            }
             debug("Stream::initHook(initHookAtIocRun) Re-inititializing %s\n", stream->name());
             if (!stream->startProtocol(StartInit))
             {
                 error("%s: Re-initialization failed.\n",
                     stream->name());
+                continue;
             }
             stream->initDone.wait();
         }
+        if (streamParallelInit) parallelInit();
+    }
+}
+#endif
+
+#ifndef EPICS_3_13
+// Run the @init handlers of all records marked by initRecord or initHook.
+// They start only after record support has initialized all records,
+// so they never write record fields concurrently with init_record.
+// Records on the same port are serialized by the bus lock anyway,
+// thus this takes about as long as the slowest port.
+void Stream::
+parallelInit()
+{
+    struct PortInit
+    {
+        PortInit* next;
+        StreamBuffer port;
+        epicsTime start;
+        epicsTime end;
+        int records;
+        int failed;
+    };
+    PortInit* ports = NULL;
+    PortInit* p;
+    Stream* stream;
+    int records = 0;
+    epicsTime start = epicsTime::getCurrent();
+    epicsTime end = start;
+
+    for (stream = static_cast<Stream*>(first); stream;
+        stream = static_cast<Stream*>(stream->next))
+    {
+        if (!stream->initPending) continue;
+        debug("Stream::parallelInit: starting @init of %s\n", stream->name());
+        stream->initStart = epicsTime::getCurrent();
+        if (!stream->startProtocol(StartInit))
+        {
+            error("%s: Can't start @init handler\n",
+                stream->name());
+            stream->initPending = false;
+        }
+    }
+    for (stream = static_cast<Stream*>(first); stream;
+        stream = static_cast<Stream*>(stream->next))
+    {
+        if (!stream->initPending) continue;
+        debug("Stream::parallelInit: waiting for %s\n", stream->name());
+        stream->initDone.wait();
+        stream->initPending = false;
+        if (stream->status != NO_ALARM)
+        {
+            // what initRecord reports when it waits for @init
+            stream->record->stat = stream->status;
+            error("%s: @init handler failed\n",
+                stream->name());
+            error("%s: Record initialization failed\n",
+                stream->name());
+        }
+
+        // collect statistics per port (bus name without address)
+        StreamBuffer port(stream->busName());
+        ssize_t i = port.find(' ');
+        if (i >= 0) port.truncate(i);
+        for (p = ports; p; p = p->next)
+            if (strcmp(p->port(), port()) == 0) break;
+        if (!p)
+        {
+            p = new PortInit;
+            p->next = ports;
+            ports = p;
+            p->port = port;
+            p->start = stream->initStart;
+            p->end = stream->initEnd;
+            p->records = 0;
+            p->failed = 0;
+        }
+        if (stream->initStart - p->start < 0) p->start = stream->initStart;
+        if (stream->initEnd - p->end > 0) p->end = stream->initEnd;
+        if (stream->initStart - start < 0) start = stream->initStart;
+        if (stream->initEnd - end > 0) end = stream->initEnd;
+        p->records++;
+        if (stream->status != NO_ALARM) p->failed++;
+        records++;
+    }
+    if (!records) return;
+    printf("streamParallelInit: @init of %d records took %.3f seconds\n",
+        records, end - start);
+    while (ports)
+    {
+        p = ports;
+        printf("  %s: %d records, %d failed, %.3f seconds\n",
+            p->port(), p->records, p->failed, p->end - p->start);
+        ports = p->next;
+        delete p;
     }
 }
 #endif
@@ -522,7 +661,12 @@ long streamInit(int after)
         {
             // restore error filtering to previous setting
             streamError = oldStreamError;
+#ifndef EPICS_3_13
+            // all records are initialized, now run @init in parallel
+            Stream::parallelInit();
+#endif
             StreamProtocolParser::free();
+            StreamCore::flushProtocolCache();
             first = 0;
         }
     }
@@ -651,6 +795,16 @@ long streamPrintf(dbCommon *record, format_t *format, ...)
     return success ? OK : ERROR;
 }
 
+long streamPrintArray(dbCommon *record, format_t *format,
+    const void* buffer, unsigned short type, size_t nelm)
+{
+    debug("streamPrintArray(%s,format=%%%c,nelm=%" Z "u)\n",
+        record->name, format->priv->conv, nelm);
+    Stream* stream = static_cast<Stream*>(record->dpvt);
+    if (!stream) return ERROR;
+    return stream->printArray(format, buffer, type, nelm) ? OK : ERROR;
+}
+
 ssize_t streamScanfN(dbCommon* record, format_t *format,
     void* value, size_t maxStringSize)
 {
@@ -661,6 +815,14 @@ ssize_t streamScanfN(dbCommon* record, format_t *format,
     return size;
 }
 
+ssize_t streamScanArray(dbCommon* record, format_t *format,
+    void* buffer, unsigned short type, size_t nelm)
+{
+    Stream* stream = static_cast<Stream*>(record->dpvt);
+    if (!stream) return ERROR;
+    return stream->scanArray(format, buffer, type, nelm);
+}
+
 // Stream methods ////////////////////////////////////////////////////////
 
 Stream::
@@ -678,6 +840,7 @@ Stream(dbCommon* _record, const struct link *ioLink,
 #else
     timerQueue = &epicsTimerQueueActive::allocate(true);
     timer = &timerQueue->createTimer();
+    initPending = false;
 #endif
     callbackSetCallback(executeCommand, &commandCallback);
     callbackSetUser(this, &commandCallback);
@@ -819,7 +982,19 @@ initRecord(char* linkstring /* modifiable copy */)
             name());
     }
 
-    if (!onInit) return DO_NOT_CONVERT; // no @init handler, keep DOL
+    if (!compiled->onInit) return DO_NOT_CONVERT; // no @init handler, keep DOL
+
+#ifndef EPICS_3_13
+    if (streamParallelInit && !interruptAccept)
+    {
+        // record support continues after we return,
+        // thus streamInit(after) runs @init for all records
+        debug("Stream::initRecord %s: deferring parallel @init\n",
+            name());
+        initPending = true;
+        return DO_NOT_CONVERT;
+    }
+#endif
 
     // initialize the record from hardware
     if (!startProtocol(StartInit))
@@ -959,6 +1134,285 @@ scan(format_t *format, void* value, size_t maxStringSize)
     return OK;
 }
 
+template<class T>
+bool Stream::
+printLongElements(const StreamFormat& fmt, const T* buffer, size_t nelm)
+{
+    StreamFormatConverter* converter = StreamFormatConverter::find(fmt.conv);
+    size_t n;
+
+    for (n = 0; n < nelm; n++)
+    {
+        printSeparator();
+        if (!converter->printLong(fmt, outputLine, (long)buffer[n]))
+        {
+            error("%s: Formatting value %li failed\n",
+                name(), (long)buffer[n]);
+            return false;
+        }
+    }
+    return true;
+}
+
+template<class T>
+bool Stream::
+printDoubleElements(const StreamFormat& fmt, const T* buffer, size_t nelm)
+{
+    StreamFormatConverter* converter = StreamFormatConverter::find(fmt.conv);
+    size_t n;
+
+    for (n = 0; n < nelm; n++)
+    {
+        printSeparator();
+        if (!converter->printDouble(fmt, outputLine, (double)buffer[n]))
+        {
+            error("%s: Formatting value %#g failed\n",
+                name(), (double)buffer[n]);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Stream::
+printArray(format_t *format, const void* buffer, unsigned short type,
+    size_t nelm)
+{
+    // called by streamPrintArray
+    // Print nelm elements of an array of the given DBF type
+    // with separators.
+
+    const StreamFormat& fmt = *format->priv;
+    const char* string;
+    size_t n;
+
+    // Guess the output size to avoid growing outputLine repeatedly.
+    outputLine.prealloc(nelm * (compiled->separator.length() +
+        (fmt.width > 8 ? fmt.width : 8)));
+    switch (format->type)
+    {
+        case DBF_DOUBLE:
+            switch (type)
+            {
+                case DBF_DOUBLE:
+                    return printDoubleElements(fmt, (const epicsFloat64*)buffer, nelm);
+                case DBF_FLOAT:
+                    return printDoubleElements(fmt, (const epicsFloat32*)buffer, nelm);
+#ifdef DBR_INT64
+                case DBF_INT64:
+                    return printDoubleElements(fmt, (const epicsInt64*)buffer, nelm);
+                case DBF_UINT64:
+                    return printDoubleElements(fmt, (const epicsUInt64*)buffer, nelm);
+#endif
+                case DBF_LONG:
+                    return printDoubleElements(fmt, (const epicsInt32*)buffer, nelm);
+                case DBF_ULONG:
+                    return printDoubleElements(fmt, (const epicsUInt32*)buffer, nelm);
+                case DBF_SHORT:
+                case DBF_ENUM:
+                    return printDoubleElements(fmt, (const epicsInt16*)buffer, nelm);
+                case DBF_USHORT:
+                    return printDoubleElements(fmt, (const epicsUInt16*)buffer, nelm);
+                case DBF_CHAR:
+                    return printDoubleElements(fmt, (const epicsInt8*)buffer, nelm);
+                case DBF_UCHAR:
+                    return printDoubleElements(fmt, (const epicsUInt8*)buffer, nelm);
+            }
+            break;
+        case DBF_ULONG:
+        case DBF_LONG:
+        case DBF_ENUM:
+            switch (type)
+            {
+#ifdef DBR_INT64
+                case DBF_INT64:
+                    return printLongElements(fmt, (const epicsInt64*)buffer, nelm);
+                case DBF_UINT64:
+                    return printLongElements(fmt, (const epicsUInt64*)buffer, nelm);
+#endif
+                case DBF_LONG:
+                    return printLongElements(fmt, (const epicsInt32*)buffer, nelm);
+                case DBF_ULONG:
+                    return printLongElements(fmt, (const epicsUInt32*)buffer, nelm);
+                case DBF_SHORT:
+                case DBF_ENUM:
+                    return printLongElements(fmt, (const epicsInt16*)buffer, nelm);
+                case DBF_USHORT:
+                    return printLongElements(fmt, (const epicsUInt16*)buffer, nelm);
+                case DBF_CHAR:
+                    return printLongElements(fmt, (const epicsInt8*)buffer, nelm);
+                case DBF_UCHAR:
+                    return printLongElements(fmt, (const epicsUInt8*)buffer, nelm);
+            }
+            break;
+        case DBF_STRING:
+            if (type != DBF_STRING) break;
+            for (n = 0; n < nelm; n++)
+            {
+                string = (const char*)buffer + n * MAX_STRING_SIZE;
+                if (!printValue(fmt, (char*)string)) return false;
+            }
+            return true;
+    }
+    error("%s: can't convert from %s to %s\n",
+        name(), pamapdbfType[type].strvalue,
+        pamapdbfType[format->type].strvalue);
+    return false;
+}
+
+template<class V, class T>
+size_t Stream::
+scanElements(const StreamFormat& fmt, T* buffer, size_t nelm)
+{
+    V value;
+    size_t n;
+
+    for (n = 0; n < nelm; n++)
+    {
+        consumedInput += currentValueLength;
+        currentValueLength = scanValue(fmt, value);
+        if (currentValueLength < 0)
+        {
+            currentValueLength = 0;
+            break;
+        }
+        buffer[n] = (T)value;
+    }
+    return n;
+}
+
+static bool canScanArray(unsigned char formatType, unsigned short type)
+{
+    // Which array types can Stream::scanArray() handle?
+    switch (type)
+    {
+        case DBF_DOUBLE:
+        case DBF_FLOAT:
+            return formatType != DBF_STRING;
+#ifdef DBR_INT64
+        case DBF_INT64:
+        case DBF_UINT64:
+#endif
+        case DBF_LONG:
+        case DBF_ULONG:
+        case DBF_SHORT:
+        case DBF_USHORT:
+        case DBF_ENUM:
+        case DBF_CHAR:
+        case DBF_UCHAR:
+            return formatType != DBF_STRING && formatType != DBF_DOUBLE;
+        case DBF_STRING:
+            return formatType == DBF_STRING;
+    }
+    return false;
+}
+
+ssize_t Stream::
+scanArray(format_t *format, void* buffer, unsigned short type, size_t nelm)
+{
+    // called by streamScanArray
+    // Scan up to nelm elements with separators into an array of
+    // the given DBF type. Returns the number of elements or ERROR.
+
+    const StreamFormat& fmt = *format->priv;
+    size_t n = 0;
+    size_t size;
+    ssize_t consumed;
+
+    if (!canScanArray(format->type, type))
+    {
+        error("%s: can't convert from %s to %s\n",
+            name(), pamapdbfType[format->type].strvalue,
+            pamapdbfType[type].strvalue);
+        return ERROR;
+    }
+    consumedInput += currentValueLength;
+    currentValueLength = 0;
+    if (format->type != DBF_STRING &&
+        (format->type == DBF_DOUBLE) == (type == DBF_DOUBLE || type == DBF_FLOAT))
+    {
+        // Some converters (e.g. binary) can copy the whole array at once
+        size = dbValueSize(type);
+        n = nelm;
+        consumed = StreamCore::scanArray(fmt, buffer, size, n);
+        if (consumed >= 0)
+        {
+            debug("Stream::scanArray(%s) %" Z "u of %" Z "u elements in bulk\n",
+                name(), n, nelm);
+            if (n == 0) return ERROR;
+            // Like scan(), leave the last value in inputLine.
+            consumedInput += consumed - size;
+            currentValueLength = size;
+            return n;
+        }
+    }
+    switch (format->type)
+    {
+        case DBF_DOUBLE:
+            switch (type)
+            {
+                case DBF_DOUBLE:
+                    n = scanElements<double>(fmt, (epicsFloat64*)buffer, nelm);
+                    break;
+                case DBF_FLOAT:
+                    n = scanElements<double>(fmt, (epicsFloat32*)buffer, nelm);
+                    break;
+            }
+            break;
+        case DBF_ULONG:
+        case DBF_LONG:
+        case DBF_ENUM:
+            switch (type)
+            {
+                case DBF_DOUBLE:
+                    n = scanElements<long>(fmt, (epicsFloat64*)buffer, nelm);
+                    break;
+                case DBF_FLOAT:
+                    n = scanElements<long>(fmt, (epicsFloat32*)buffer, nelm);
+                    break;
+#ifdef DBR_INT64
+                case DBF_INT64:
+                case DBF_UINT64:
+                    n = scanElements<long>(fmt, (epicsInt64*)buffer, nelm);
+                    break;
+#endif
+                case DBF_LONG:
+                case DBF_ULONG:
+                    n = scanElements<long>(fmt, (epicsInt32*)buffer, nelm);
+                    break;
+                case DBF_SHORT:
+                case DBF_USHORT:
+                case DBF_ENUM:
+                    n = scanElements<long>(fmt, (epicsInt16*)buffer, nelm);
+                    break;
+                case DBF_CHAR:
+                case DBF_UCHAR:
+                    n = scanElements<long>(fmt, (epicsInt8*)buffer, nelm);
+                    break;
+            }
+            break;
+        case DBF_STRING:
+            for (n = 0; n < nelm; n++)
+            {
+                consumedInput += currentValueLength;
+                size = MAX_STRING_SIZE;
+                currentValueLength = scanValue(fmt,
+                    (char*)buffer + n * MAX_STRING_SIZE, size);
+                if (currentValueLength < 0)
+                {
+                    currentValueLength = 0;
+                    break;
+                }
+            }
+            break;
+    }
+    debug("Stream::scanArray(%s) %" Z "u of %" Z "u elements\n",
+        name(), n, nelm);
+    // Like scan(), leave the last value in inputLine for error messages.
+    if (n == 0) return ERROR;
+    return n;
+}
+
 // epicsTimerNotify virtual method ///////////////////////////////////////
 
 #ifdef EPICS_3_13
@@ -1035,6 +1489,7 @@ protocolFinishHook(ProtocolResult result)
 #ifdef EPICS_3_13
         semGive(initDone);
 #else
+        initEnd = epicsTime::getCurrent();
         initDone.signal();
 #endif
         return;
@@ -1133,7 +1588,6 @@ formatValue(const StreamFormat& format, const void* fieldaddress)
     {
         // Format like "%([record.]field)..." has requested to get value
         // from field of this or other record.
-        StreamBuffer fieldBuffer;
         DBADDR* pdbaddr = (DBADDR*)fieldaddress;
 
         /* Handle time stamps special. %T converter takes double. */
@@ -1260,6 +1714,38 @@ formatValue(const StreamFormat& format, const void* fieldaddress)
     return true;
 }
 
+#ifndef EPICS_3_13
+static void* fieldMemory(DBADDR* pdbaddr)
+{
+    // Return the field memory if dbPut() would simply copy to it.
+    // Arrays with an offset (circular buffers) are not that simple.
+    dbCommon* precord = pdbaddr->precord;
+    long nelem, offset = 0;
+
+    if (pdbaddr->special == 0) return pdbaddr->pfield;
+    if (pdbaddr->special != SPC_DBADDR) return NULL;
+    if (precord->rset->get_array_info)
+        ((long (*)(DBADDR*, long*, long*))precord->rset->get_array_info)
+            (pdbaddr, &nelem, &offset);
+    return offset == 0 ? pdbaddr->pfield : NULL;
+}
+
+static void fieldWritten(DBADDR* pdbaddr, long nord)
+{
+    // Do what dbPut() does after writing to the field.
+    dbCommon* precord = pdbaddr->precord;
+    dbFldDes* pfldDes = (dbFldDes*)pdbaddr->pfldDes;
+    int isValueField = dbIsValueField(pfldDes);
+
+    if (pdbaddr->special == SPC_DBADDR && precord->rset->put_array_info)
+        ((long (*)(DBADDR*, long))precord->rset->put_array_info)
+            (pdbaddr, nord);
+    if (isValueField) precord->udf = false;
+    if (precord->mlis.count && !(isValueField && pfldDes->process_passive))
+        db_post_events(precord, pdbaddr->pfield, DBE_VALUE | DBE_LOG);
+}
+#endif
+
 bool Stream::
 matchValue(const StreamFormat& format, const void* fieldaddress)
 {
@@ -1279,109 +1765,147 @@ matchValue(const StreamFormat& format, const void* fieldaddress)
     {
         // Format like "%([record.]field)..." has requested to put value
         // to field of this or other record.
-        StreamBuffer fieldBuffer;
         DBADDR* pdbaddr = (DBADDR*)fieldaddress;
         size_t size;
         size_t nord;
         size_t nelem = pdbaddr->no_elements;
-        if (format.type == string_format &&
-            (pdbaddr->field_type == DBF_CHAR || pdbaddr->field_type == DBF_UCHAR))
+        ssize_t n;
+        bool bulk = false;
+        if (strcmp(((dbFldDes*)pdbaddr->pfldDes)->name, "TIME") != 0 &&
+            format.type != string_format &&
+            canScanArray(fmt.type, pdbaddr->field_type))
         {
-            // string to char array
-            size = nelem;
+            // Scan numbers in the type of the field to avoid converting
+            // them again in dbPut.
+#ifndef EPICS_3_13
+            if (pdbaddr->precord == record &&
+                (buffer = (char*)fieldMemory(pdbaddr)) != NULL)
+            {
+                // Our own record is busy with this protocol,
+                // thus we can write directly to the field.
+                currentValueLength = 0;
+                n = scanArray(&fmt, buffer, pdbaddr->field_type, nelem);
+                consumedInput += currentValueLength;
+                currentValueLength = 0;
+                if (n == ERROR) return false;
+                fieldWritten(pdbaddr, n);
+                debug("Stream::matchValue(%s): %" Z "d elements written to %s.%s\n",
+                    name(), n, pdbaddr->precord->name,
+                    ((dbFldDes*)pdbaddr->pfldDes)->name);
+                return true;
+            }
+#endif
+            buffer = fieldBuffer.clear().reserve(
+                nelem * dbValueSize(pdbaddr->field_type));
+            currentValueLength = 0;
+            n = scanArray(&fmt, buffer, pdbaddr->field_type, nelem);
+            consumedInput += currentValueLength;
+            currentValueLength = 0;
+            nord = n == ERROR ? 0 : n;
+            fmt.type = pdbaddr->field_type;
+            bulk = true;
         }
         else
-            size = nelem * dbValueSize(fmt.type);
-        buffer = fieldBuffer.clear().reserve(size);  // maybe write to field directly in case types match?
-        for (nord = 0; nord < nelem; nord++)
         {
-            debug("Stream::matchValue(%s): buffer before: %s\n",
-                name(), fieldBuffer.expand()());
-            switch (format.type)
+            if (format.type == string_format &&
+                (pdbaddr->field_type == DBF_CHAR || pdbaddr->field_type == DBF_UCHAR))
             {
-                case unsigned_format:
-                {
-                    consumed = scanValue(format, lval);
-                    if (consumed >= 0) ((epicsUInt32*)buffer)[nord] = lval;
-                    debug("Stream::matchValue(%s): %s.%s[%" Z "u] = %lu\n",
-                            name(), pdbaddr->precord->name,
-                            ((dbFldDes*)pdbaddr->pfldDes)->name,
-                            nord, lval);
-                    break;
-                }
-                case signed_format:
-                {
-                    consumed = scanValue(format, lval);
-                    if (consumed >= 0) ((epicsInt32*)buffer)[nord] = lval;
-                    debug("Stream::matchValue(%s): %s.%s[%" Z "u] = %li\n",
-                            name(), pdbaddr->precord->name,
-                            ((dbFldDes*)pdbaddr->pfldDes)->name,
-                            nord, lval);
-                    break;
-                }
-                case enum_format:
-                {
-                    consumed = scanValue(format, lval);
-                    if (consumed >= 0)
-                        ((epicsUInt16*)buffer)[nord] = (epicsUInt16)lval;
-                    debug("Stream::matchValue(%s): %s.%s[%" Z "u] = %li\n",
-                            name(), pdbaddr->precord->name,
-                            ((dbFldDes*)pdbaddr->pfldDes)->name,
-                            nord, lval);
-                    break;
-                }
-                case double_format:
-                {
-                    consumed = scanValue(format, dval);
-                    // Direct assignment to buffer fails with
-                    // gcc 3.4.3 for xscale_be
-                    // Optimization bug?
-                    epicsFloat64 f64=dval;
-                    if (consumed >= 0)
-                        memcpy(((epicsFloat64*)buffer)+nord,
-                            &f64, sizeof(f64));
-                    debug("Stream::matchValue(%s): %s.%s[%" Z "u] = %#g %#g\n",
-                            name(), pdbaddr->precord->name,
-                            ((dbFldDes*)pdbaddr->pfldDes)->name,
-                            nord, dval,
-                            ((epicsFloat64*)buffer)[nord]);
-                    break;
-                }
-                case string_format:
+                // string to char array
+                size = nelem;
+            }
+            else
+                size = nelem * dbValueSize(fmt.type);
+            buffer = fieldBuffer.clear().reserve(size);
+            for (nord = 0; nord < nelem; nord++)
+            {
+                debug("Stream::matchValue(%s): buffer before: %s\n",
+                    name(), fieldBuffer.expand()());
+                switch (format.type)
                 {
-                    if (pdbaddr->field_type == DBF_CHAR ||
-                        pdbaddr->field_type == DBF_UCHAR)
+                    case unsigned_format:
                     {
-                        // string to char array
-                        stringsize = nelem;
-                        consumed = scanValue(format, buffer, stringsize);
-                        debug("Stream::matchValue(%s): %s.%s = \"%.*s\"\n",
+                        consumed = scanValue(format, lval);
+                        if (consumed >= 0) ((epicsUInt32*)buffer)[nord] = lval;
+                        debug("Stream::matchValue(%s): %s.%s[%" Z "u] = %lu\n",
                                 name(), pdbaddr->precord->name,
                                 ((dbFldDes*)pdbaddr->pfldDes)->name,
-                                (int)consumed, buffer);
-                        nord = nelem; // this shortcuts the loop
+                                nord, lval);
+                        break;
                     }
-                    else
+                    case signed_format:
                     {
-                        stringsize = MAX_STRING_SIZE;
-                        consumed = scanValue(format,
-                            buffer+MAX_STRING_SIZE*nord, stringsize);
-                        debug("Stream::matchValue(%s): %s.%s[%" Z "u] = \"%.*s\"\n",
+                        consumed = scanValue(format, lval);
+                        if (consumed >= 0) ((epicsInt32*)buffer)[nord] = lval;
+                        debug("Stream::matchValue(%s): %s.%s[%" Z "u] = %li\n",
                                 name(), pdbaddr->precord->name,
                                 ((dbFldDes*)pdbaddr->pfldDes)->name,
-                                nord, (int)stringsize, buffer+MAX_STRING_SIZE*nord);
+                                nord, lval);
+                        break;
                     }
-                    break;
+                    case enum_format:
+                    {
+                        consumed = scanValue(format, lval);
+                        if (consumed >= 0)
+                            ((epicsUInt16*)buffer)[nord] = (epicsUInt16)lval;
+                        debug("Stream::matchValue(%s): %s.%s[%" Z "u] = %li\n",
+                                name(), pdbaddr->precord->name,
+                                ((dbFldDes*)pdbaddr->pfldDes)->name,
+                                nord, lval);
+                        break;
+                    }
+                    case double_format:
+                    {
+                        consumed = scanValue(format, dval);
+                        // Direct assignment to buffer fails with
+                        // gcc 3.4.3 for xscale_be
+                        // Optimization bug?
+                        epicsFloat64 f64=dval;
+                        if (consumed >= 0)
+                            memcpy(((epicsFloat64*)buffer)+nord,
+                                &f64, sizeof(f64));
+                        debug("Stream::matchValue(%s): %s.%s[%" Z "u] = %#g %#g\n",
+                                name(), pdbaddr->precord->name,
+                                ((dbFldDes*)pdbaddr->pfldDes)->name,
+                                nord, dval,
+                                ((epicsFloat64*)buffer)[nord]);
+                        break;
+                    }
+                    case string_format:
+                    {
+                        if (pdbaddr->field_type == DBF_CHAR ||
+                            pdbaddr->field_type == DBF_UCHAR)
+                        {
+                            // string to char array
+                            stringsize = nelem;
+                            consumed = scanValue(format, buffer, stringsize);
+                            debug("Stream::matchValue(%s): %s.%s = \"%.*s\"\n",
+                                    name(), pdbaddr->precord->name,
+                                    ((dbFldDes*)pdbaddr->pfldDes)->name,
+                                    (int)consumed, buffer);
+                            nord = nelem; // this shortcuts the loop
+                        }
+                        else
+                        {
+                            stringsize = MAX_STRING_SIZE;
+                            consumed = scanValue(format,
+                                buffer+MAX_STRING_SIZE*nord, stringsize);
+                            debug("Stream::matchValue(%s): %s.%s[%" Z "u] = \"%.*s\"\n",
+                                    name(), pdbaddr->precord->name,
+                                    ((dbFldDes*)pdbaddr->pfldDes)->name,
+                                    nord, (int)stringsize, buffer+MAX_STRING_SIZE*nord);
+                        }
+                        break;
+                    }
+                    default:
+                        error("INTERNAL ERROR: Stream::matchValue %s: "
+                            "Illegal format type\n", name());
+                        return false;
                 }
-                default:
-                    error("INTERNAL ERROR: Stream::matchValue %s: "
-                        "Illegal format type\n", name());
-                    return false;
+                debug("Stream::matchValue(%s): buffer after: %s\n",
+                    name(), fieldBuffer.expand()());
+                if (consumed < 0) break;
+                consumedInput += consumed;
             }
-            debug("Stream::matchValue(%s): buffer after: %s\n",
-                name(), fieldBuffer.expand()());
-            if (consumed < 0) break;
-            consumedInput += consumed;
         }
         if (!nord)
         {
@@ -1465,7 +1989,8 @@ matchValue(const StreamFormat& format, const void* fieldaddress)
         if (status != 0)
         {
             flags &= ~ScanTried;
-            switch (fmt.type)
+            // values scanned in bulk are not in lval, dval or consumed
+            if (!bulk) switch (fmt.type)
             {
                 case DBF_ULONG:
                 case DBF_LONG:
@@ -1492,8 +2017,13 @@ matchValue(const StreamFormat& format, const void* fieldaddress)
                         (int)consumed, buffer, nord);
                     return false;
                 default:
-                    return false;
+                    break;
             }
+            error("%s: %s(%s.%s, %s, %" Z "u elements) failed\n",
+                name(), putfunc, pdbaddr->precord->name,
+                ((dbFldDes*)pdbaddr->pfldDes)->name,
+                pamapdbfType[fmt.type].strvalue, nord);
+            return false;
         }
         return true;
     }
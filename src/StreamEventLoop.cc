@@ -0,0 +1,970 @@
+/*************************************************************************
+* This is the event loop for the native bus interfaces of StreamDevice.
+* Please see ../docs/ for detailed documentation.
+*
+* This file is part of StreamDevice.
+*
+* StreamDevice is free software: You can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* StreamDevice is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with StreamDevice. If not, see https://www.gnu.org/licenses/.
+*************************************************************************/
+
+#include "StreamEventLoop.h"
+#include "epicsExport.h"
+
+// number of event loop threads, read when the first port is created
+int streamEventLoopThreads = 2;
+// use io_uring if built with it and the kernel supports it
+int streamIoUring = 1;
+extern "C" {
+epicsExportAddress(int, streamEventLoopThreads);
+epicsExportAddress(int, streamIoUring);
+}
+
+#ifdef WITH_EVENTLOOP
+
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "StreamError.h"
+
+#ifdef WITH_IO_URING
+#include <stdlib.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#ifndef IORING_RECV_MULTISHOT
+#error "STREAM_IO_URING needs linux/io_uring.h of Linux 6.0 or newer"
+#endif
+#endif
+
+#define MAX_EVENTS 64
+#define MAX_SLEEP 100
+
+StreamEventLoop* StreamEventLoop::loops;
+int StreamEventLoop::numLoops;
+int StreamEventLoop::nextLoop;
+
+unsigned long long StreamEventLoop::
+now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+void StreamEventLoop::
+createLoops(void*)
+{
+    numLoops = streamEventLoopThreads;
+    if (numLoops < 1) numLoops = 1;
+    loops = new StreamEventLoop[numLoops];
+    for (int i = 0; i < numLoops; i++)
+        loops[i].start(i);
+}
+
+// Sources are distributed round robin over the loops.
+StreamEventLoop* StreamEventLoop::
+get()
+{
+    static epicsThreadOnceId once = EPICS_THREAD_ONCE_INIT;
+    epicsThreadOnce(&once, createLoops, NULL);
+    StreamEventLoop* loop = &loops[nextLoop];
+    nextLoop = (nextLoop + 1) % numLoops;
+    return loop;
+}
+
+StreamEventLoop::
+StreamEventLoop()
+{
+    thread = NULL;
+    timers = NULL;
+    sleepUntil = 0;
+    running = NULL;
+    waiting = 0;
+    polls = 0;
+    events = 0;
+    expired = 0;
+    wakeups = 0;
+    syscalls = 0;
+    threadname[0] = 0;
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    wakefd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (epfd < 0 || wakefd < 0)
+    {
+        error("StreamEventLoop: cannot create epoll instance: %s\n",
+            strerror(errno));
+        return;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &event);
+#ifdef WITH_IO_URING
+    ring = NULL;
+    epollReady = false;
+    if (streamIoUring && setupRing())
+    {
+        // the ring reads wakefd itself
+        epoll_ctl(epfd, EPOLL_CTL_DEL, wakefd, &event);
+        armWakeup();
+        armEpoll();
+    }
+#endif
+}
+
+void StreamEventLoop::
+start(int index)
+{
+    sprintf(threadname, "streamLoop%d", index);
+    thread = epicsThreadCreate(threadname, epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackBig), run, this);
+    if (!thread)
+        error("StreamEventLoop: cannot start thread %s\n", threadname);
+    debug("StreamEventLoop::start: thread %s started\n", threadname);
+}
+
+void StreamEventLoop::
+wakeup()
+{
+    uint64_t one = 1;
+    if (write(wakefd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        error("StreamEventLoop %s: wakeup failed: %s\n",
+            threadname, strerror(errno));
+}
+
+bool StreamEventLoop::
+isStale(Source* source)
+{
+    Source** s = (Source**)stale();
+    size_t n = stale.length() / sizeof(Source*);
+    for (size_t i = 0; i < n; i++)
+        if (s[i] == source) return true;
+    return false;
+}
+
+void StreamEventLoop::
+markStale(Source* source)
+{
+    stale.append(&source, sizeof(source));
+}
+
+void StreamEventLoop::
+handlerDone()
+{
+    mutex.lock();
+    running = NULL;
+    if (waiting) idle.signal();
+    mutex.unlock();
+}
+
+// Wait up to timeout ms for epoll events and handle them.
+void StreamEventLoop::
+dispatchEpoll(int timeout)
+{
+    struct epoll_event ev[MAX_EVENTS];
+    Source* source;
+    int i, n;
+
+    n = epoll_wait(epfd, ev, MAX_EVENTS, timeout);
+    syscalls++;
+    mutex.lock();
+    sleepUntil = 0;
+    mutex.unlock();
+    if (n < 0)
+    {
+        if (errno == EINTR) return;
+        error("StreamEventLoop %s: epoll_wait failed: %s\n",
+            threadname, strerror(errno));
+        epicsThreadSleep(1.0);
+        return;
+    }
+#ifdef WITH_IO_URING
+    // Level triggered events may still be pending without a new
+    // notification of the ring. Look again until nothing is left.
+    epollReady = n > 0;
+#endif
+    polls++;
+    for (i = 0; i < n; i++)
+    {
+        source = static_cast<Source*>(ev[i].data.ptr);
+        if (!source)
+        {
+            uint64_t count;
+            syscalls++;
+            if (read(wakefd, &count, sizeof(count)) > 0) wakeups++;
+            continue;
+        }
+        mutex.lock();
+        if (isStale(source))
+        {
+            mutex.unlock();
+            continue;
+        }
+        running = source;
+        mutex.unlock();
+        events++;
+        source->ioReady(ev[i].events);
+        handlerDone();
+    }
+}
+
+void StreamEventLoop::
+run()
+{
+    Source* source;
+    unsigned long long t;
+    int timeout;
+
+    debug("StreamEventLoop::run: thread %s running\n", threadname);
+    while (1)
+    {
+        mutex.lock();
+        // Events of sources detached from now on may be outdated.
+        stale.clear();
+        // Sleep at most MAX_SLEEP, then timers started meanwhile
+        // with longer timeouts need no wakeup.
+        t = now();
+        sleepUntil = t + MAX_SLEEP;
+        if (timers && timers->expires < sleepUntil)
+            sleepUntil = timers->expires;
+        timeout = sleepUntil > t ? (int)(sleepUntil - t) : 0;
+        mutex.unlock();
+#ifdef WITH_IO_URING
+        if (ring)
+        {
+            waitRing(timeout);
+            handleCompletions();
+            if (epollReady) dispatchEpoll(0);
+        }
+        else
+#endif
+        dispatchEpoll(timeout);
+        mutex.lock();
+        t = now();
+        while (timers && timers->expires <= t)
+        {
+            source = timers;
+            timers = source->nextTimer;
+            source->timerActive = false;
+            running = source;
+            mutex.unlock();
+            expired++;
+            source->timerExpired();
+            mutex.lock();
+            running = NULL;
+            if (waiting) idle.signal();
+        }
+        mutex.unlock();
+    }
+}
+
+void StreamEventLoop::
+removeTimer(Source* source)
+{
+    Source** ps;
+    for (ps = &timers; *ps; ps = &(*ps)->nextTimer)
+    {
+        if (*ps == source)
+        {
+            *ps = source->nextTimer;
+            break;
+        }
+    }
+    source->timerActive = false;
+}
+
+void StreamEventLoop::
+printStatus(StreamBuffer& buffer)
+{
+    buffer.print("%s %s polls=%lu events=%lu timers=%lu wakeups=%lu"
+        " syscalls=%lu",
+#ifdef WITH_IO_URING
+        threadname, ring ? "io_uring" : "epoll",
+#else
+        threadname, "epoll",
+#endif
+        polls, events, expired, wakeups, syscalls);
+}
+
+StreamEventLoop::Source::
+Source(StreamEventLoop* loop) : loop(loop)
+{
+    nextTimer = NULL;
+    expires = 0;
+    timerActive = false;
+    fd = -1;
+    events = 0;
+    recvSlot = -1;
+}
+
+StreamEventLoop::Source::
+~Source()
+{
+}
+
+void StreamEventLoop::Source::
+ioReady(unsigned int)
+{
+}
+
+void StreamEventLoop::Source::
+timerExpired()
+{
+}
+
+void StreamEventLoop::Source::
+dataReceived(const char*, ssize_t)
+{
+}
+
+// Watch a file descriptor or change the events of interest.
+// The loop uses level triggered events.
+bool StreamEventLoop::Source::
+watch(int newfd, unsigned int newevents)
+{
+    struct epoll_event event;
+    int op;
+
+    loop->mutex.lock();
+    if (newfd == fd && newevents == events)
+    {
+        loop->mutex.unlock();
+        return true;
+    }
+    if (fd >= 0 && (fd != newfd || !newevents))
+    {
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, &event);
+        loop->markStale(this);
+        fd = -1;
+        events = 0;
+    }
+    if (!newevents)
+    {
+        loop->mutex.unlock();
+        return true;
+    }
+    op = fd == newfd ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    event.events = newevents;
+    event.data.ptr = this;
+    if (epoll_ctl(loop->epfd, op, newfd, &event) != 0)
+    {
+        error("StreamEventLoop %s: cannot watch fd %d: %s\n",
+            loop->threadname, newfd, strerror(errno));
+        loop->mutex.unlock();
+        return false;
+    }
+    fd = newfd;
+    events = newevents;
+    loop->mutex.unlock();
+    return true;
+}
+
+// Call before closing the file descriptor.
+void StreamEventLoop::Source::
+unwatch()
+{
+    struct epoll_event event;
+
+    loop->mutex.lock();
+#ifdef WITH_IO_URING
+    loop->cancelReceive(this);
+#endif
+    if (fd >= 0)
+    {
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, &event);
+        loop->markStale(this);
+        fd = -1;
+        events = 0;
+    }
+    loop->mutex.unlock();
+}
+
+void StreamEventLoop::Source::
+startTimer(unsigned long timeout_ms)
+{
+    Source** ps;
+
+    loop->mutex.lock();
+    if (timerActive) loop->removeTimer(this);
+    expires = now() + timeout_ms;
+    for (ps = &loop->timers; *ps; ps = &(*ps)->nextTimer)
+        if ((*ps)->expires > expires) break;
+    nextTimer = *ps;
+    *ps = this;
+    timerActive = true;
+    // Wake the loop only if it would sleep too long.
+    if (expires < loop->sleepUntil)
+        loop->wakeup();
+    loop->mutex.unlock();
+}
+
+void StreamEventLoop::Source::
+cancelTimer()
+{
+    loop->mutex.lock();
+    if (timerActive) loop->removeTimer(this);
+    loop->mutex.unlock();
+}
+
+void StreamEventLoop::Source::
+detach()
+{
+    struct epoll_event event;
+
+    loop->mutex.lock();
+#ifdef WITH_IO_URING
+    loop->cancelReceive(this);
+#endif
+    if (fd >= 0)
+    {
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, &event);
+        fd = -1;
+    }
+    if (timerActive) loop->removeTimer(this);
+    loop->markStale(this);
+    while (loop->running == this && !inLoopThread())
+    {
+        loop->waiting++;
+        loop->mutex.unlock();
+        loop->idle.wait();
+        loop->mutex.lock();
+        loop->waiting--;
+        if (loop->waiting) loop->idle.signal();
+    }
+    loop->mutex.unlock();
+}
+
+#ifdef WITH_IO_URING
+
+/* How io_uring is used:
+
+Each loop has a ring with a ring of buffers registered with the kernel
+(or given to the kernel with requests if it ignores the buffer ring).
+Sockets passed to receive() get a multishot receive: it stays active
+and the kernel copies each input into a free buffer of the loop and
+posts a completion, without any read() call.
+The loop thread waits for completions and timers with one
+io_uring_enter() call, which also submits the requests queued
+since the last call. Other threads submit their requests at once.
+The ring also reads the wakeup eventfd and polls the epoll instance,
+which still watches all file descriptors not passed to receive(),
+e.g. connecting sockets, sockets waiting to be writable, ttys and
+the UDP socket.
+Writes are still done with a direct write() or send() by the caller.
+This is already one call per request and it keeps the order of
+the bytes, thus requests are not linked to the receive.
+*/
+
+// user_data of the requests
+static const __u64 IgnoreTag = 0;
+static const __u64 WakeupTag = 1;
+static const __u64 EpollTag = 2;
+static const __u64 ReceiveTag = 1ULL << 63; // | slot
+
+static const unsigned int RingEntries = 256;
+static const unsigned int CompletionEntries = 4096;
+static const unsigned int Buffers = 256;     // power of 2
+static const unsigned int BufferSize = 4096;
+
+struct StreamEventLoop::Ring
+{
+    int fd;
+    // submission queue
+    unsigned int* sqHead;
+    unsigned int* sqTail;
+    unsigned int sqMask;
+    unsigned int* sqArray;
+    struct io_uring_sqe* sqes;
+    unsigned int pending;   // queued by the loop thread, not submitted
+    // completion queue
+    unsigned int* cqHead;
+    unsigned int* cqTail;
+    unsigned int cqMask;
+    struct io_uring_cqe* cqes;
+    void* rings;
+    size_t ringsSize;
+    size_t sqesSize;
+    // provided buffers
+    struct io_uring_buf_ring* bufRing;
+    size_t bufRingSize;
+    char* buffers;
+    unsigned short bufTail;
+    // active receives, indexed by slot
+    struct Slot {
+        Source* source;     // NULL when stopped
+        int fd;
+        bool busy;          // until the last completion
+    }* slots;
+    int numSlots;
+    uint64_t wakeValue;
+
+    Ring();
+    ~Ring();
+    struct io_uring_sqe* nextSqe();
+};
+
+static int
+ioUringEnter(int fd, unsigned int toSubmit, unsigned int minComplete,
+    unsigned int flags, void* arg, size_t argsize)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+        flags, arg, argsize);
+}
+
+StreamEventLoop::Ring::
+Ring()
+{
+    fd = -1;
+    rings = MAP_FAILED;
+    sqes = (struct io_uring_sqe*)MAP_FAILED;
+    bufRing = (struct io_uring_buf_ring*)MAP_FAILED;
+    buffers = NULL;
+    bufTail = 0;
+    pending = 0;
+    slots = NULL;
+    numSlots = 0;
+    wakeValue = 0;
+}
+
+StreamEventLoop::Ring::
+~Ring()
+{
+    if (fd >= 0) close(fd);
+    if (rings != MAP_FAILED) munmap(rings, ringsSize);
+    if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+    if (bufRing != MAP_FAILED) munmap(bufRing, bufRingSize);
+    free(buffers);
+    free(slots);
+}
+
+// Called with the loop mutex locked.
+struct io_uring_sqe* StreamEventLoop::Ring::
+nextSqe()
+{
+    unsigned int tail = *sqTail;
+    if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) > sqMask)
+    {
+        // full: submit what the loop thread has queued so far
+        ioUringEnter(fd, pending, 0, 0, NULL, 0);
+        pending = 0;
+    }
+    struct io_uring_sqe* sqe = &sqes[tail & sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[tail & sqMask] = tail & sqMask;
+    return sqe;
+}
+
+// Give count buffers starting with bid back to the kernel.
+// Only called by the loop thread.
+void StreamEventLoop::
+returnBuffers(unsigned short bid, unsigned int count)
+{
+    if (ring->bufRing != MAP_FAILED)
+    {
+        while (count--)
+        {
+            struct io_uring_buf* buf =
+                &ring->bufRing->bufs[ring->bufTail & (Buffers - 1)];
+            buf->addr = (uintptr_t)(ring->buffers + (size_t)bid * BufferSize);
+            buf->len = BufferSize;
+            buf->bid = bid++;
+            ring->bufTail++;
+        }
+        __atomic_store_n(&ring->bufRing->tail, ring->bufTail,
+            __ATOMIC_RELEASE);
+        return;
+    }
+    // without buffer ring (Linux 5.7): provide them with a request
+    mutex.lock();
+    struct io_uring_sqe* sqe = ring->nextSqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = count;
+    sqe->addr = (uintptr_t)(ring->buffers + (size_t)bid * BufferSize);
+    sqe->len = BufferSize;
+    sqe->off = bid;
+    sqe->buf_group = 0;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = IgnoreTag;
+    submit(1);
+    mutex.unlock();
+}
+
+// Publish the sqe from nextSqe(). The loop thread submits with its next
+// wait, other threads at once. Called with the loop mutex locked.
+void StreamEventLoop::
+submit(unsigned int count)
+{
+    __atomic_store_n(ring->sqTail, *ring->sqTail + count, __ATOMIC_RELEASE);
+    if (inLoopThread())
+    {
+        ring->pending += count;
+        return;
+    }
+    if (ioUringEnter(ring->fd, count, 0, 0, NULL, 0) < 0)
+        error("StreamEventLoop %s: io_uring_enter failed: %s\n",
+            threadname, strerror(errno));
+}
+
+void StreamEventLoop::
+armWakeup()
+{
+    mutex.lock();
+    struct io_uring_sqe* sqe = ring->nextSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakefd;
+    sqe->addr = (uintptr_t)&ring->wakeValue;
+    sqe->len = sizeof(ring->wakeValue);
+    sqe->user_data = WakeupTag;
+    submit(1);
+    mutex.unlock();
+}
+
+void StreamEventLoop::
+armEpoll()
+{
+    mutex.lock();
+    struct io_uring_sqe* sqe = ring->nextSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = epfd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = EpollTag;
+    submit(1);
+    mutex.unlock();
+}
+
+// Called with the loop mutex locked.
+void StreamEventLoop::
+armReceive(int slot)
+{
+    struct io_uring_sqe* sqe = ring->nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = ring->slots[slot].fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = ReceiveTag | slot;
+    submit(1);
+}
+
+// Called with the loop mutex locked.
+void StreamEventLoop::
+cancelReceive(Source* source)
+{
+    int slot = source->recvSlot;
+
+    if (!ring || slot < 0) return;
+    // The slot stays busy until the last completion of the receive.
+    ring->slots[slot].source = NULL;
+    source->recvSlot = -1;
+    struct io_uring_sqe* sqe = ring->nextSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = ReceiveTag | slot;
+    sqe->user_data = IgnoreTag;
+    submit(1);
+}
+
+bool StreamEventLoop::
+setupRing()
+{
+    struct io_uring_params params;
+    struct io_uring_buf_reg reg;
+    size_t sqSize, cqSize;
+    int sv[2] = { -1, -1 };
+    int n;
+
+    ring = new Ring;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = CompletionEntries;
+    ring->fd = (int)syscall(__NR_io_uring_setup, RingEntries, &params);
+    if (ring->fd < 0 && errno == EINVAL)
+    {
+        // kernel older than 5.19, then the rest fails anyway
+        params.flags &= ~IORING_SETUP_COOP_TASKRUN;
+        ring->fd = (int)syscall(__NR_io_uring_setup, RingEntries, &params);
+    }
+    if (ring->fd < 0) goto fail;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(params.features & IORING_FEAT_EXT_ARG) ||
+        !(params.features & IORING_FEAT_NODROP))
+    {
+        errno = ENOSYS;
+        goto fail;
+    }
+    sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cqSize = params.cq_off.cqes +
+        params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ringsSize = sqSize > cqSize ? sqSize : cqSize;
+    ring->rings = mmap(NULL, ring->ringsSize, PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->rings == MAP_FAILED) goto fail;
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqesSize,
+        PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+        ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) goto fail;
+    ring->sqHead = (unsigned int*)((char*)ring->rings + params.sq_off.head);
+    ring->sqTail = (unsigned int*)((char*)ring->rings + params.sq_off.tail);
+    ring->sqMask =
+        *(unsigned int*)((char*)ring->rings + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned int*)((char*)ring->rings + params.sq_off.array);
+    ring->cqHead = (unsigned int*)((char*)ring->rings + params.cq_off.head);
+    ring->cqTail = (unsigned int*)((char*)ring->rings + params.cq_off.tail);
+    ring->cqMask =
+        *(unsigned int*)((char*)ring->rings + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)
+        ((char*)ring->rings + params.cq_off.cqes);
+
+    // register the buffers (Linux 5.19)
+    ring->bufRingSize = Buffers * sizeof(struct io_uring_buf);
+    ring->bufRing = (struct io_uring_buf_ring*)mmap(NULL, ring->bufRingSize,
+        PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (ring->bufRing == MAP_FAILED) goto fail;
+    ring->buffers = (char*)malloc((size_t)Buffers * BufferSize);
+    if (!ring->buffers) goto fail;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)ring->bufRing;
+    reg.ring_entries = Buffers;
+    reg.bgid = 0;
+    if (syscall(__NR_io_uring_register, ring->fd,
+        IORING_REGISTER_PBUF_RING, &reg, 1) != 0) goto fail;
+    returnBuffers(0, Buffers);
+
+    // Multishot receive needs Linux 6.0. Try it on a socket pair.
+    if (socketpair(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC,
+        0, sv) != 0) goto fail;
+    if (write(sv[1], "x", 1) != 1) goto fail;
+    ring->slots = (Ring::Slot*)calloc(1, sizeof(Ring::Slot));
+    if (!ring->slots) goto fail;
+    ring->numSlots = 1;
+    ring->slots[0].fd = sv[0];
+    ring->slots[0].busy = true;
+    while (1)
+    {
+        mutex.lock();
+        armReceive(0);
+        mutex.unlock();
+        n = ioUringEnter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (n < 0) goto fail;
+        unsigned int head = *ring->cqHead;
+        struct io_uring_cqe* cqe = &ring->cqes[head & ring->cqMask];
+        int res = cqe->res;
+        unsigned int flags = cqe->flags;
+        __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+        if (flags & IORING_CQE_F_BUFFER)
+            returnBuffers(flags >> IORING_CQE_BUFFER_SHIFT, 1);
+        if (res == 1 && (flags & IORING_CQE_F_MORE)) break;
+        if (res != -ENOBUFS || ring->bufRing == MAP_FAILED)
+        {
+            errno = res < 0 ? -res : ENOSYS;
+            goto fail;
+        }
+        // Some kernels accept the buffer ring but never take buffers
+        // from it. Use the older way to provide them then.
+        syscall(__NR_io_uring_register, ring->fd,
+            IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap(ring->bufRing, ring->bufRingSize);
+        ring->bufRing = (struct io_uring_buf_ring*)MAP_FAILED;
+        returnBuffers(0, Buffers);
+    }
+    // The test receive ends when its socket is closed.
+    // Its completions are ignored because the slot has no source.
+    close(sv[0]);
+    close(sv[1]);
+    sv[0] = sv[1] = -1;
+    debug("StreamEventLoop: using io_uring\n");
+    return true;
+
+fail:
+    error("StreamEventLoop: io_uring not available (%s), using epoll\n",
+        strerror(errno));
+    if (sv[0] >= 0) close(sv[0]);
+    if (sv[1] >= 0) close(sv[1]);
+    delete ring;
+    ring = NULL;
+    return false;
+}
+
+// Submit queued requests and wait for completions.
+int StreamEventLoop::
+waitRing(int timeout)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned int toSubmit;
+    unsigned int wait;
+    int n;
+
+    mutex.lock();
+    toSubmit = ring->pending;
+    ring->pending = 0;
+    mutex.unlock();
+    if (epollReady)
+    {
+        // epoll is looked at again anyway, do not sleep
+        if (!toSubmit) return 0;
+        timeout = 0;
+    }
+    // do not sleep if completions are already there
+    wait = *ring->cqHead ==
+        __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE) ? 1 : 0;
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000L;
+    arg.sigmask = 0;
+    arg.sigmask_sz = _NSIG / 8;
+    arg.pad = 0;
+    arg.ts = (uintptr_t)&ts;
+    n = ioUringEnter(ring->fd, toSubmit, wait,
+        IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    syscalls++;
+    mutex.lock();
+    sleepUntil = 0;
+    mutex.unlock();
+    if (n < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+    {
+        error("StreamEventLoop %s: io_uring_enter failed: %s\n",
+            threadname, strerror(errno));
+        epicsThreadSleep(1.0);
+    }
+    polls++;
+    return n;
+}
+
+void StreamEventLoop::
+handleCompletions()
+{
+    unsigned int head = *ring->cqHead;
+    unsigned int tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    struct io_uring_cqe* cqe;
+    __u64 userData;
+    unsigned int flags;
+    int res;
+
+    while (head != tail)
+    {
+        cqe = &ring->cqes[head & ring->cqMask];
+        userData = cqe->user_data;
+        res = cqe->res;
+        flags = cqe->flags;
+        // the buffer stays ours until returned
+        __atomic_store_n(ring->cqHead, ++head, __ATOMIC_RELEASE);
+        if (userData & ReceiveTag)
+            receiveDone(userData & ~ReceiveTag, res, flags);
+        else if (userData == WakeupTag)
+        {
+            if (res > 0) wakeups++;
+            armWakeup();
+        }
+        else if (userData == EpollTag)
+        {
+            epollReady = true;
+            if (!(flags & IORING_CQE_F_MORE)) armEpoll();
+        }
+    }
+}
+
+void StreamEventLoop::
+receiveDone(unsigned long long slot, int res, unsigned int flags)
+{
+    Source* source;
+    Ring::Slot* s;
+    char* data = NULL;
+
+    if (flags & IORING_CQE_F_BUFFER)
+        data = ring->buffers +
+            (size_t)(flags >> IORING_CQE_BUFFER_SHIFT) * BufferSize;
+    mutex.lock();
+    s = &ring->slots[slot]; // receive() may realloc the slots
+    source = s->source;
+    if (!(flags & IORING_CQE_F_MORE))
+    {
+        // This was the last completion of the receive.
+        if (source && (res > 0 || res == -ENOBUFS))
+            armReceive(slot); // continue
+        else
+        {
+            s->busy = false;
+            s->source = NULL;
+            if (source) source->recvSlot = -1;
+        }
+    }
+    // out of buffers is no error, nothing to tell after cancel
+    if (res == -ENOBUFS || res == -ECANCELED) source = NULL;
+    if (source) running = source;
+    mutex.unlock();
+    if (source)
+    {
+        events++;
+        source->dataReceived(data, res);
+        handlerDone();
+    }
+    if (data) returnBuffers(flags >> IORING_CQE_BUFFER_SHIFT, 1);
+}
+
+bool StreamEventLoop::Source::
+receive(int newfd)
+{
+    struct stat st;
+    Ring* ring = loop->ring;
+    int slot;
+
+    // multishot receive works on sockets only
+    if (!ring || fstat(newfd, &st) != 0 || !S_ISSOCK(st.st_mode))
+        return false;
+    loop->mutex.lock();
+    loop->cancelReceive(this);
+    for (slot = 0; slot < ring->numSlots; slot++)
+        if (!ring->slots[slot].busy) break;
+    if (slot == ring->numSlots)
+    {
+        int num = ring->numSlots * 2;
+        Ring::Slot* slots = (Ring::Slot*)realloc(ring->slots,
+            num * sizeof(Ring::Slot));
+        if (!slots)
+        {
+            loop->mutex.unlock();
+            return false;
+        }
+        memset(slots + ring->numSlots, 0,
+            (num - ring->numSlots) * sizeof(Ring::Slot));
+        ring->slots = slots;
+        ring->numSlots = num;
+    }
+    ring->slots[slot].source = this;
+    ring->slots[slot].fd = newfd;
+    ring->slots[slot].busy = true;
+    recvSlot = slot;
+    loop->armReceive(slot);
+    loop->mutex.unlock();
+    return true;
+}
+
+#else
+
+bool StreamEventLoop::Source::
+receive(int)
+{
+    return false;
+}
+
+#endif
+#endif
@@ -0,0 +1,152 @@
+/*************************************************************************
+* This is the event loop for the native bus interfaces of StreamDevice.
+* Please see ../docs/ for detailed documentation.
+*
+* This file is part of StreamDevice.
+*
+* StreamDevice is free software: You can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* StreamDevice is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with StreamDevice. If not, see https://www.gnu.org/licenses/.
+*************************************************************************/
+
+#ifndef StreamEventLoop_h
+#define StreamEventLoop_h
+
+#if defined(__linux__)
+#define WITH_EVENTLOOP
+#endif
+
+// Build with -DWITH_IO_URING (STREAM_IO_URING=YES in CONFIG_STREAM)
+// to receive on sockets with io_uring where the kernel supports it.
+#if !defined(WITH_EVENTLOOP)
+#undef WITH_IO_URING
+#endif
+
+extern int streamEventLoopThreads;
+extern int streamIoUring;
+
+#ifdef WITH_EVENTLOOP
+
+#include "epicsMutex.h"
+#include "epicsEvent.h"
+#include "epicsThread.h"
+#include "StreamBuffer.h"
+
+// A small pool of threads (streamEventLoopThreads, default 2) waits
+// for I/O and timers of many sources with epoll.
+// Handlers run in the loop thread without any loop lock held,
+// thus they may call back into StreamCore.
+// All handlers of one source run in the same thread, one at a time.
+// With io_uring, each loop waits in its ring instead and sockets passed
+// to receive() get their input from a multishot receive into buffers
+// registered with the ring, without any read() call.
+// The epoll instance is then watched by the ring for all other sources.
+
+class StreamEventLoop
+{
+public:
+    class Source
+    {
+        friend class StreamEventLoop;
+        Source* nextTimer;
+        unsigned long long expires;
+        bool timerActive;
+        int fd;
+        unsigned int events;
+        int recvSlot;
+
+    protected:
+        StreamEventLoop* loop;
+
+        Source(StreamEventLoop* loop);
+        virtual ~Source();
+
+        // Handlers, called in the loop thread.
+        virtual void ioReady(unsigned int events);
+        virtual void timerExpired();
+        // Input from receive(), 0 at end of file or -errno on error
+        virtual void dataReceived(const char* data, ssize_t size);
+
+        // These may be called in any thread.
+        bool watch(int fd, unsigned int events); // EPOLLIN, EPOLLOUT, 0
+        // Get all input of a socket with dataReceived(). Returns false
+        // if not possible, then watch for EPOLLIN and read it yourself.
+        bool receive(int fd);
+        void unwatch(); // also stops receive()
+        void startTimer(unsigned long timeout_ms);
+        void cancelTimer();
+        // Derived destructors must call detach() before the handlers
+        // can no longer run.
+        // It waits for a running handler unless called by the handler.
+        void detach();
+        bool inLoopThread() { return loop->inLoopThread(); }
+    };
+
+    static StreamEventLoop* get();
+    static unsigned long long now(); // monotonic time in ms
+    const char* name() { return threadname; }
+    bool inLoopThread() { return epicsThreadGetIdSelf() == thread; }
+    void printStatus(StreamBuffer& buffer);
+
+private:
+    static StreamEventLoop* loops;
+    static int numLoops;
+    static int nextLoop;
+    static void createLoops(void*);
+
+    char threadname[16];
+    epicsThreadId thread;
+    int epfd;
+    int wakefd;
+    epicsMutex mutex;
+#ifdef WITH_IO_URING
+    struct Ring;
+    Ring* ring;         // NULL if the kernel cannot do it
+    bool epollReady;    // look for more epoll events
+    bool setupRing();
+    void submit(unsigned int count);
+    void armWakeup();
+    void armEpoll();
+    void armReceive(int slot);
+    void returnBuffers(unsigned short bid, unsigned int count);
+    void cancelReceive(Source*);
+    int waitRing(int timeout);
+    void handleCompletions();
+    void receiveDone(unsigned long long slot, int res, unsigned int flags);
+#endif
+    epicsEvent idle;
+    Source* timers;     // sorted by expiry
+    unsigned long long sleepUntil; // 0 while not in epoll_wait()
+    Source* running;    // handler currently called
+    int waiting;        // threads waiting in detach()
+    StreamBuffer stale; // sources detached since epoll_wait() started
+    unsigned long polls;
+    unsigned long events;
+    unsigned long expired;
+    unsigned long wakeups;
+    unsigned long syscalls; // made by the loop thread
+
+    StreamEventLoop();
+    void start(int index);
+    void run();
+    static void run(void* loop)
+        { static_cast<StreamEventLoop*>(loop)->run(); }
+    void wakeup();
+    void removeTimer(Source*);
+    void markStale(Source*);
+    bool isStale(Source*);
+    void handlerDone();
+    void dispatchEpoll(int timeout);
+};
+
+#endif
+#endif
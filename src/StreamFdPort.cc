@@ -0,0 +1,926 @@
+/*************************************************************************
+* This is the common part of the native byte stream bus interfaces
+* of StreamDevice.
+* Please see ../docs/ for detailed documentation.
+*
+* This file is part of StreamDevice.
+*
+* StreamDevice is free software: You can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* StreamDevice is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with StreamDevice. If not, see https://www.gnu.org/licenses/.
+*************************************************************************/
+
+#include "StreamFdPort.h"
+
+#ifdef WITH_EVENTLOOP
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "StreamError.h"
+
+#define Z PRINTF_SIZE_T_PREFIX
+
+/* How things are implemented:
+
+A derived port, e.g. TcpPort, is created by an iocsh command. Records
+use its name as bus name like an asyn port. Many ports share few event
+loop threads (see StreamEventLoop), instead of one asyn port thread each.
+The file descriptor is non-blocking and is watched for input all the
+time while connected. With io_uring, sockets get their input from the
+loop with dataReceived() instead of being watched.
+
+lockRequest()
+    if port is free and connected
+        lockCallback() at once
+    else
+        queue by priority, connect if necessary
+        when unlock() or connect frees the port
+            lockCallback() in loop thread
+        if lockTimeout expires
+            lockCallback(StreamIoTimeout)
+        if connect fails
+            lockCallback(StreamIoFault)
+
+writeRequest()
+    discard old unread input
+    write at once
+    if all bytes are written
+        writeCallback() at once
+    else
+        write the rest when fd is writable
+        writeCallback() in loop thread when done
+        if writeTimeout expires
+            writeCallback(StreamIoTimeout)
+
+readRequest()
+    if unread input is available
+        readCallback(StreamIoSuccess) at once
+    when input arrives
+        readCallback(StreamIoSuccess) in loop thread
+        continue while readCallback() wants more
+    if replyTimeout expires before first input
+        readCallback(StreamIoNoReply)
+    if readTimeout expires later
+        readCallback(StreamIoTimeout)
+    if connection is lost
+        readCallback(StreamIoEnd) after input, else StreamIoFault
+
+asynchonous input support ("I/O Intr"):
+    every input goes to all clients waiting with async readRequest()
+    in addition to the synchronous reader (if any).
+    Input nobody waits for is kept for the next readRequest()
+    until the next writeRequest().
+
+Callbacks are never called with the port mutex held.
+*/
+
+// Input is read in chunks of this size
+static const size_t ReadSize = 4096;
+// Unread input is discarded beyond this size
+static const size_t MaxUnread = 65536;
+static const unsigned long ReconnectDelay = 1000;
+
+StreamFdPort* StreamFdPort::first;
+
+StreamFdPort::
+StreamFdPort(const char* _type, const char* _name, const char* _hostInfo,
+    StreamEventLoop* loop) :
+    StreamEventLoop::Source(loop ? loop : StreamEventLoop::get()),
+    type(_type)
+{
+    name = new char[strlen(_name) + 1];
+    strcpy(name, _name);
+    hostInfo = new char[strlen(_hostInfo) + 1];
+    strcpy(hostInfo, _hostInfo);
+    fd = -1;
+    state = Disconnected;
+    autoConnect = true;
+    reported = false;
+    datagrams = false;
+    receiving = false;
+    waiting = 0;
+    clients = NULL;
+    owner = NULL;
+    lockQueue = NULL;
+    current = NULL;
+    connects = 0;
+    reads = 0;
+    bytesIn = 0;
+    writes = 0;
+    directWrites = 0;
+    bytesOut = 0;
+    discarded = 0;
+    syscalls = 0;
+    chunk.prealloc(ReadSize);
+    next = NULL;
+    StreamFdPort** pp;
+    for (pp = &first; *pp; pp = &(*pp)->next);
+    *pp = this;
+}
+
+StreamFdPort::
+~StreamFdPort()
+{
+    // ports live until the IOC exits
+    detach();
+    if (fd >= 0) close(fd);
+    delete[] name;
+    delete[] hostInfo;
+}
+
+StreamFdPort* StreamFdPort::
+find(const char* name, const char* type)
+{
+    StreamFdPort* port;
+    for (port = first; port; port = port->next)
+        if (strcmp(port->name, name) == 0) break;
+    if (port && type && strcmp(port->type, type) != 0) return NULL;
+    return port;
+}
+
+void StreamFdPort::
+start()
+{
+    mutex.lock();
+    connect();
+    mutex.unlock();
+}
+
+void StreamFdPort::
+connect()
+{
+    if (state != Disconnected) return;
+    debug("StreamFdPort::connect(%s) to %s %s\n", name, type, hostInfo);
+    connects++;
+    open();
+    // continues with opened() or openFailed()
+}
+
+void StreamFdPort::
+openReady()
+{
+    opened();
+}
+
+ssize_t StreamFdPort::
+writeBytes(const void* output, size_t size)
+{
+    return write(fd, output, size);
+}
+
+void StreamFdPort::
+opened()
+{
+    StreamFdInterface* client;
+
+    debug("StreamFdPort::opened(%s) to %s\n", name, hostInfo);
+    cancelTimer();
+    state = Connected;
+    reported = false;
+    if (fd >= 0)
+    {
+        receiving = receive(fd);
+        watchOutput(false);
+    }
+    for (client = clients; client; client = client->next)
+    {
+        if (client->ioAction == StreamFdInterface::Connect)
+            client->complete(StreamIoSuccess);
+    }
+    grantLock();
+}
+
+void StreamFdPort::
+openFailed(int err)
+{
+    StreamFdInterface* client;
+
+    if (!reported)
+        error("%s: Cannot connect to %s: %s\n",
+            name, hostInfo, strerror(err));
+    reported = true;
+    if (fd >= 0)
+    {
+        unwatch();
+        close(fd);
+        fd = -1;
+        receiving = false;
+    }
+    cancelTimer();
+    state = Disconnected;
+    // Nobody should wait for a dead device.
+    while (lockQueue)
+    {
+        client = lockQueue;
+        lockQueue = client->nextLock;
+        client->complete(StreamIoFault);
+    }
+    for (client = clients; client; client = client->next)
+    {
+        if (client->ioAction == StreamFdInterface::Connect ||
+            client->ioAction == StreamFdInterface::Read)
+            client->complete(StreamIoFault);
+    }
+    if (autoConnect && asyncReaders())
+        startTimer(ReconnectDelay);
+}
+
+void StreamFdPort::
+closeConnection()
+{
+    StreamFdInterface* client;
+
+    debug("StreamFdPort::closeConnection(%s)\n", name);
+    if (fd >= 0)
+    {
+        unwatch();
+        close(fd);
+        fd = -1;
+        receiving = false;
+    }
+    cancelTimer();
+    state = Disconnected;
+    discarded += input.length() + output.length();
+    input.clear();
+    output.clear();
+    for (client = clients; client; client = client->next)
+    {
+        if (client->ioAction == StreamFdInterface::Write)
+            client->complete(StreamIoFault);
+        if (client->ioAction == StreamFdInterface::Read)
+            client->complete(client->received ? StreamIoEnd : StreamIoFault);
+    }
+    if (autoConnect && (lockQueue || asyncReaders()))
+        startTimer(ReconnectDelay);
+}
+
+bool StreamFdPort::
+asyncReaders()
+{
+    StreamFdInterface* client;
+    for (client = clients; client; client = client->next)
+        if (client->ioAction == StreamFdInterface::AsyncRead) return true;
+    return false;
+}
+
+void StreamFdPort::
+queueLock(StreamFdInterface* client)
+{
+    // higher priority first, same priority in order of request
+    long prio = client->priority();
+    StreamFdInterface** pc;
+    for (pc = &lockQueue; *pc; pc = &(*pc)->nextLock)
+        if ((*pc)->priority() < prio) break;
+    client->nextLock = *pc;
+    *pc = client;
+}
+
+void StreamFdPort::
+dequeueLock(StreamFdInterface* client)
+{
+    StreamFdInterface** pc;
+    for (pc = &lockQueue; *pc; pc = &(*pc)->nextLock)
+    {
+        if (*pc == client)
+        {
+            *pc = client->nextLock;
+            break;
+        }
+    }
+}
+
+void StreamFdPort::
+grantLock()
+{
+    if (owner || state != Connected || !lockQueue) return;
+    owner = lockQueue;
+    lockQueue = owner->nextLock;
+    debug("StreamFdPort::grantLock(%s) to %s\n", name, owner->clientName());
+    owner->complete(StreamIoSuccess);
+}
+
+// Watch fd for input unless receiving and for output if requested.
+void StreamFdPort::
+watchOutput(bool on)
+{
+    unsigned int wanted = 0;
+
+    if (!receiving) wanted |= EPOLLIN;
+    if (on) wanted |= EPOLLOUT;
+    watch(fd, wanted);
+}
+
+// Wait until the loop thread has returned from a callback to client.
+void StreamFdPort::
+waitIdle(StreamFdInterface* client)
+{
+    while (current == client && !inLoopThread())
+    {
+        waiting++;
+        mutex.unlock();
+        idle.wait();
+        mutex.lock();
+        waiting--;
+        if (waiting) idle.signal();
+    }
+}
+
+// Give the last chunk of input to client.
+// The client stays linked to the port while mutex is unlocked.
+ssize_t StreamFdPort::
+deliver(StreamFdInterface* client)
+{
+    ssize_t more;
+
+    current = client;
+    mutex.unlock();
+    more = client->readCallback(datagrams ? StreamIoEnd : StreamIoSuccess,
+        chunk(), chunk.length());
+    mutex.lock();
+    current = NULL;
+    if (waiting) idle.signal();
+    return more;
+}
+
+// Keep the last chunk for the next readRequest().
+void StreamFdPort::
+keepInput()
+{
+    if (input.length() + chunk.length() > MaxUnread)
+    {
+        discarded += input.length();
+        input.clear();
+    }
+    if (datagrams)
+    {
+        // keep message boundaries
+        size_t len = chunk.length();
+        input.append(&len, sizeof(len));
+    }
+    input.append(chunk);
+}
+
+// Take unread input, only the oldest datagram if the port has datagrams.
+void StreamFdPort::
+takeInput(StreamBuffer& buffer)
+{
+    size_t len;
+
+    if (!datagrams)
+    {
+        buffer.swap(input);
+        return;
+    }
+    memcpy(&len, input(), sizeof(len));
+    buffer.set(input(sizeof(len)), len);
+    input.remove(sizeof(len) + len);
+}
+
+void StreamFdPort::
+readInput()
+{
+    ssize_t n;
+
+    chunk.clear();
+    n = read(fd, chunk.reserve(ReadSize), ReadSize);
+    syscalls++;
+    if (n <= 0)
+    {
+        chunk.clear();
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return;
+        inputFailed(n < 0 ? errno : 0);
+        return;
+    }
+    chunk.truncate(n);
+    received();
+}
+
+// Input from the loop with io_uring
+void StreamFdPort::
+dataReceived(const char* data, ssize_t size)
+{
+    mutex.lock();
+    if (state == Connected && receiving)
+    {
+        if (size > 0)
+        {
+            chunk.set(data, size);
+            received();
+        }
+        else
+            inputFailed(-size);
+    }
+    mutex.unlock();
+}
+
+// Called by ports without fd when output may be possible again.
+void StreamFdPort::
+writable()
+{
+    mutex.lock();
+    if (state == Connected && output)
+        writeOutput();
+    mutex.unlock();
+}
+
+// Read error or end of input if err is 0
+void StreamFdPort::
+inputFailed(int err)
+{
+    if (err)
+        error("%s: Read from %s failed: %s\n",
+            name, hostInfo, strerror(err));
+    else
+        debug("StreamFdPort::inputFailed(%s): connection closed by %s\n",
+            name, hostInfo);
+    closeConnection();
+}
+
+// Pass the input in chunk to the clients.
+void StreamFdPort::
+received()
+{
+    StreamFdInterface* reader = NULL;
+    StreamFdInterface* client;
+    bool async = false;
+
+    reads++;
+    bytesIn += chunk.length();
+    debug("StreamFdPort::received(%s): \"%s\"\n", name, chunk.expand()());
+
+    // the lock owner reads first, else anyone with a pending read
+    if (owner && owner->ioAction == StreamFdInterface::Read)
+        reader = owner;
+    else for (client = clients; client; client = client->next)
+    {
+        if (client->ioAction == StreamFdInterface::Read)
+        {
+            reader = client;
+            break;
+        }
+    }
+    for (client = clients; client; client = client->next)
+    {
+        client->marked = client->ioAction == StreamFdInterface::AsyncRead;
+        async |= client->marked;
+    }
+    // A lock owner between its write and its readRequest() must not
+    // lose the reply to async readers.
+    if (!reader && (!async || owner))
+        keepInput();
+    if (!reader && !async)
+        return;
+    if (reader)
+    {
+        reader->ioAction = StreamFdInterface::None;
+        reader->cancelTimer();
+        reader->received = true;
+        if (deliver(reader) && reader->ioAction == StreamFdInterface::None)
+        {
+            // wait for more
+            reader->ioAction = StreamFdInterface::Read;
+            reader->startTimer(reader->readTimeout);
+        }
+    }
+    for (client = clients; client; client = client->next)
+    {
+        if (!client->marked) continue;
+        client->marked = false;
+        if (client->ioAction != StreamFdInterface::AsyncRead) continue;
+        client->ioAction = StreamFdInterface::None;
+        client->cancelTimer();
+        if (deliver(client) && client->ioAction == StreamFdInterface::None)
+        {
+            // partial input, restart async read
+            client->ioAction = StreamFdInterface::AsyncRead;
+            client->startTimer(client->readTimeout);
+        }
+    }
+}
+
+void StreamFdPort::
+writeOutput()
+{
+    ssize_t n;
+
+    n = writeBytes(output(), output.length());
+    writes++;
+    if (fd >= 0) syscalls++;
+    if (n < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return;
+        error("%s: Write to %s failed: %s\n",
+            name, hostInfo, strerror(errno));
+        closeConnection();
+        return;
+    }
+    bytesOut += n;
+    output.remove(n);
+    if (output) return;
+    if (fd >= 0) watchOutput(false);
+    if (owner && owner->ioAction == StreamFdInterface::Write)
+        owner->complete(StreamIoSuccess);
+}
+
+void StreamFdPort::
+ioReady(unsigned int events)
+{
+    mutex.lock();
+    debug("StreamFdPort::ioReady(%s, 0x%x) %s\n",
+        name, events, toStr(state));
+    if (state == Connecting)
+        openReady();
+    else if (state == Connected)
+    {
+        if (events & EPOLLOUT && output)
+            writeOutput();
+        if (state == Connected && !receiving &&
+            events & (EPOLLIN|EPOLLERR|EPOLLHUP))
+            readInput();
+    }
+    mutex.unlock();
+}
+
+void StreamFdPort::
+timerExpired()
+{
+    mutex.lock();
+    debug("StreamFdPort::timerExpired(%s) %s\n", name, toStr(state));
+    if (state == Connecting)
+        openFailed(ETIMEDOUT);
+    else if (state == Disconnected && autoConnect &&
+        (lockQueue || asyncReaders()))
+        connect();
+    mutex.unlock();
+}
+
+StreamFdInterface::
+StreamFdInterface(Client* client, StreamFdPort* port) :
+    StreamBusInterface(client),
+    StreamEventLoop::Source(port->loop),
+    port(port)
+{
+    nextLock = NULL;
+    ioAction = None;
+    ioStatus = StreamIoSuccess;
+    ioDone = false;
+    received = false;
+    marked = false;
+    readTimeout = 0;
+    port->mutex.lock();
+    next = port->clients;
+    port->clients = this;
+    port->mutex.unlock();
+}
+
+StreamFdInterface::
+~StreamFdInterface()
+{
+    // unlink first, the loop thread may still call complete()
+    port->mutex.lock();
+    port->waitIdle(this);
+    StreamFdInterface** pc;
+    for (pc = &port->clients; *pc; pc = &(*pc)->next)
+    {
+        if (*pc == this)
+        {
+            *pc = next;
+            break;
+        }
+    }
+    port->dequeueLock(this);
+    if (port->owner == this)
+    {
+        port->owner = NULL;
+        port->grantLock();
+    }
+    port->mutex.unlock();
+    detach();
+}
+
+StreamFdPort* StreamFdInterface::
+findPort(const char* busname, int addr, const char* type)
+{
+    StreamFdPort* port = StreamFdPort::find(busname, type);
+    if (port && addr >= 0)
+    {
+        // do not silently talk to the whole port
+        error("%s: %s ports have no addresses, cannot use address %d\n",
+            busname, type, addr);
+        return NULL;
+    }
+    return port;
+}
+
+bool StreamFdInterface::
+supportsAsyncRead()
+{
+    return true;
+}
+
+// The port has decided the result of the pending action.
+// Report it from the loop thread.
+void StreamFdInterface::
+complete(StreamIoStatus status)
+{
+    ioStatus = status;
+    ioDone = true;
+    startTimer(0);
+}
+
+bool StreamFdInterface::
+lockRequest(unsigned long lockTimeout_ms)
+{
+    debug("StreamFdInterface::lockRequest(%s, %ld msec)\n",
+        clientName(), lockTimeout_ms);
+    port->mutex.lock();
+    port->autoConnect = true;
+    if (!port->owner && !port->lockQueue &&
+        port->state == StreamFdPort::Connected)
+    {
+        port->owner = this;
+        port->mutex.unlock();
+        lockCallback();
+        return true;
+    }
+    ioAction = Lock;
+    ioDone = false;
+    if (lockTimeout_ms) startTimer(lockTimeout_ms);
+    port->queueLock(this);
+    port->connect();
+    port->mutex.unlock();
+    return true;
+    // continues with:
+    //    grantLock() -> timerExpired() -> lockCallback()
+}
+
+bool StreamFdInterface::
+unlock()
+{
+    debug("StreamFdInterface::unlock(%s)\n",
+        clientName());
+    port->mutex.lock();
+    if (port->owner == this)
+    {
+        port->owner = NULL;
+        port->grantLock();
+    }
+    port->mutex.unlock();
+    return true;
+}
+
+bool StreamFdInterface::
+writeRequest(const void* output, size_t size,
+    unsigned long writeTimeout_ms)
+{
+    ssize_t n = 0;
+
+    debug("StreamFdInterface::writeRequest(%s, \"%s\", %ld msec)\n",
+        clientName(), StreamBuffer(output, size).expand()(),
+        writeTimeout_ms);
+    port->mutex.lock();
+    if (port->state != StreamFdPort::Connected)
+    {
+        port->mutex.unlock();
+        error("%s: Cannot write to %s: not connected\n",
+            clientName(), port->name);
+        return false;
+    }
+    // old input is no reply to this output
+    if (port->input)
+    {
+        port->discarded += port->input.length();
+        port->input.clear();
+    }
+    if (!port->output)
+    {
+        n = port->writeBytes(output, size);
+        port->writes++;
+        if (port->fd >= 0) port->syscalls++;
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                error("%s: Write to %s failed: %s\n",
+                    clientName(), port->hostInfo, strerror(errno));
+                port->closeConnection();
+                port->mutex.unlock();
+                return false;
+            }
+            n = 0;
+        }
+        port->bytesOut += n;
+        if ((size_t)n == size)
+        {
+            port->directWrites++;
+            port->mutex.unlock();
+            writeCallback();
+            return true;
+        }
+    }
+    port->output.append(static_cast<const char*>(output) + n, size - n);
+    ioAction = Write;
+    ioDone = false;
+    startTimer(writeTimeout_ms);
+    // ports without fd call writable() instead
+    if (port->fd >= 0) port->watchOutput(true);
+    port->mutex.unlock();
+    return true;
+    // continues with:
+    //    writeOutput() -> timerExpired() -> writeCallback()
+    // or timerExpired() -> writeCallback(StreamIoTimeout)
+}
+
+bool StreamFdInterface::
+readRequest(unsigned long replyTimeout_ms, unsigned long readTimeout_ms,
+    ssize_t expectedLength, bool async)
+{
+    debug("StreamFdInterface::readRequest(%s, %ld msec reply, "
+        "%ld msec read, expect %" Z "d bytes, async=%s)\n",
+        clientName(), replyTimeout_ms, readTimeout_ms,
+        expectedLength, async ? "yes" : "no");
+
+    port->mutex.lock();
+    readTimeout = readTimeout_ms;
+    received = false;
+    ioDone = false;
+    if (async)
+    {
+        // no polling, input is watched all the time
+        ioAction = AsyncRead;
+        if (port->state == StreamFdPort::Disconnected && port->autoConnect)
+            port->connect();
+        port->mutex.unlock();
+        return true;
+    }
+    port->autoConnect = true;
+    if (port->input)
+    {
+        StreamBuffer input;
+        port->takeInput(input);
+        ioAction = None;
+        received = true;
+        port->mutex.unlock();
+        if (readCallback(port->datagrams ? StreamIoEnd : StreamIoSuccess,
+            input(), input.length()))
+        {
+            port->mutex.lock();
+            if (ioAction == None)
+            {
+                ioAction = Read;
+                startTimer(readTimeout);
+            }
+            port->mutex.unlock();
+        }
+        return true;
+    }
+    ioAction = Read;
+    startTimer(replyTimeout_ms);
+    port->connect();
+    port->mutex.unlock();
+    return true;
+    // continues with:
+    //    readInput() -> readCallback()
+    // or timerExpired() -> readCallback(StreamIoNoReply)
+}
+
+bool StreamFdInterface::
+connectRequest(unsigned long connecttimeout_ms)
+{
+    debug("StreamFdInterface::connectRequest(%s)\n", clientName());
+    port->mutex.lock();
+    port->autoConnect = true;
+    if (port->state == StreamFdPort::Connected)
+    {
+        port->mutex.unlock();
+        connectCallback();
+        return true;
+    }
+    ioAction = Connect;
+    ioDone = false;
+    startTimer(connecttimeout_ms);
+    port->connect();
+    port->mutex.unlock();
+    return true;
+}
+
+bool StreamFdInterface::
+disconnectRequest()
+{
+    debug("StreamFdInterface::disconnectRequest(%s)\n", clientName());
+    port->mutex.lock();
+    port->autoConnect = false;
+    port->closeConnection();
+    port->mutex.unlock();
+    disconnectCallback();
+    return true;
+}
+
+void StreamFdInterface::
+finish()
+{
+    debug("StreamFdInterface::finish(%s)\n", clientName());
+    cancelTimer();
+    port->mutex.lock();
+    if (ioAction == Lock)
+    {
+        port->dequeueLock(this);
+        if (port->owner == this)
+        {
+            // granted but not yet reported
+            port->owner = NULL;
+            port->grantLock();
+        }
+    }
+    ioAction = None;
+    ioDone = false;
+    port->mutex.unlock();
+}
+
+void StreamFdInterface::
+timerExpired()
+{
+    StreamIoStatus status = StreamIoTimeout;
+
+    port->mutex.lock();
+    IoAction action = ioAction;
+    debug("StreamFdInterface::timerExpired(%s) %s %s\n",
+        clientName(), toStr(action),
+        ioDone ? ::toStr(ioStatus) : "timeout");
+    switch (action)
+    {
+        case Lock:
+            if (!ioDone) port->dequeueLock(this);
+            break;
+        case Write:
+            if (!ioDone)
+            {
+                port->discarded += port->output.length();
+                port->output.clear();
+                if (port->state == StreamFdPort::Connected && port->fd >= 0)
+                    port->watchOutput(false);
+            }
+            break;
+        case Read:
+            if (!received) status = StreamIoNoReply;
+            break;
+        case AsyncRead:
+        case Connect:
+            break;
+        default:
+            port->mutex.unlock();
+            return;
+    }
+    if (ioDone) status = ioStatus;
+    ioAction = None;
+    ioDone = false;
+    port->mutex.unlock();
+    switch (action)
+    {
+        case Lock:
+            lockCallback(status);
+            break;
+        case Write:
+            writeCallback(status);
+            break;
+        case Read:
+        case AsyncRead:
+            readCallback(status);
+            break;
+        case Connect:
+            connectCallback(status);
+            break;
+        default:
+            break;
+    }
+}
+
+void StreamFdInterface::
+printStatus(StreamBuffer& buffer)
+{
+    port->mutex.lock();
+    buffer.print(" %s %s %s %s", port->type, port->hostInfo,
+        StreamFdPort::toStr(port->state), toStr(ioAction));
+    buffer.print(" connects=%lu reads=%lu bytes=%lu"
+        " writes=%lu direct=%lu bytes=%lu discarded=%lu syscalls=%lu ",
+        port->connects, port->reads, port->bytesIn,
+        port->writes, port->directWrites, port->bytesOut,
+        port->discarded, port->syscalls);
+    port->printStatus(buffer);
+    port->loop->printStatus(buffer);
+    port->mutex.unlock();
+}
+
+#endif
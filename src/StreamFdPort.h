@@ -0,0 +1,176 @@
+/*************************************************************************
+* This is the common part of the native byte stream bus interfaces
+* of StreamDevice.
+* Please see ../docs/ for detailed documentation.
+*
+* This file is part of StreamDevice.
+*
+* StreamDevice is free software: You can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* StreamDevice is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with StreamDevice. If not, see https://www.gnu.org/licenses/.
+*************************************************************************/
+
+#ifndef StreamFdPort_h
+#define StreamFdPort_h
+
+#include "StreamEventLoop.h"
+
+#ifdef WITH_EVENTLOOP
+
+#include <sys/types.h>
+#include "StreamBusInterface.h"
+#include "MacroMagic.h"
+
+// A StreamFdPort talks to a device through a non-blocking file
+// descriptor of a byte stream (TCP socket, tty, ...) in an event loop.
+// StreamFdInterface is the bus interface of one record on such a port.
+// Derived ports only implement how to open the connection.
+// Ports without an own file descriptor (e.g. UDP) pass their input in
+// with received() and set datagrams if each input is a whole message.
+// Terminators are not handled here: all input is passed on as it comes
+// and StreamCore finds the terminator itself.
+
+class StreamFdInterface;
+
+class StreamFdPort : protected StreamEventLoop::Source
+{
+    friend class StreamFdInterface;
+
+    static StreamFdPort* first;
+    StreamFdPort* next;
+    bool autoConnect;         // false after "disconnect"
+    epicsEvent idle;
+    int waiting;              // threads waiting for current callback
+    StreamFdInterface* clients;
+    StreamFdInterface* owner;
+    StreamFdInterface* lockQueue;
+    StreamFdInterface* current; // client in callback from loop thread
+    StreamBuffer input;       // input nobody has read yet
+    StreamBuffer output;      // output not yet written
+    unsigned long reads;
+    unsigned long bytesIn;
+    unsigned long writes;
+    unsigned long directWrites;
+    unsigned long bytesOut;
+    unsigned long discarded;
+    unsigned long syscalls;   // read() and write() calls
+    bool receiving;           // input comes with dataReceived()
+
+    void connect();
+    void closeConnection();
+    void grantLock();
+    void queueLock(StreamFdInterface* client);
+    void dequeueLock(StreamFdInterface* client);
+    void readInput();
+    void inputFailed(int err);
+    void keepInput();
+    void takeInput(StreamBuffer& buffer);
+    void writeOutput();
+    ssize_t deliver(StreamFdInterface* client);
+    void waitIdle(StreamFdInterface* client);
+    void watchOutput(bool on);
+    bool asyncReaders();
+
+    // StreamEventLoop::Source methods
+    void ioReady(unsigned int events);
+    void timerExpired();
+    void dataReceived(const char* data, ssize_t size);
+
+protected:
+    ENUM (State,
+        Disconnected, Connecting, Connected);
+
+    const char* type;
+    char* name;
+    char* hostInfo;
+    int fd;                   // -1 if input comes from elsewhere
+    State state;
+    bool datagrams;           // each chunk is a complete message
+    StreamBuffer chunk;       // last input read by loop thread
+    bool reported;            // open error already printed
+    epicsMutex mutex;
+    unsigned long connects;
+
+    StreamFdPort(const char* type, const char* name, const char* hostInfo,
+        StreamEventLoop* loop = NULL);
+    virtual ~StreamFdPort();
+
+    // These are called with mutex locked.
+    // open() sets fd and calls opened() or openFailed().
+    // Or it sets state to Connecting, watches fd for EPOLLOUT and
+    // calls opened() or openFailed() later from openReady().
+    virtual void open() = 0;
+    virtual void openReady();
+    virtual ssize_t writeBytes(const void* output, size_t size);
+    virtual void printStatus(StreamBuffer&) {}
+    void opened();
+    void openFailed(int err);
+    // retry pending output, with mutex unlocked
+    void writable();
+    // pass input in chunk to the clients, with mutex locked
+    void received();
+
+public:
+    // any port if type is NULL
+    static StreamFdPort* find(const char* name, const char* type = NULL);
+    // connect right away like asyn ports do
+    void start();
+};
+
+class StreamFdInterface : public StreamBusInterface,
+    protected StreamEventLoop::Source
+{
+    friend class StreamFdPort;
+
+    ENUM (IoAction,
+        None, Lock, Write, Read, AsyncRead, Connect);
+
+    StreamFdPort* port;
+    StreamFdInterface* next;     // all clients of the port
+    StreamFdInterface* nextLock; // lock queue of the port
+    IoAction ioAction;
+    StreamIoStatus ioStatus;  // result decided by the port
+    bool ioDone;
+    bool received;            // got input in this read
+    bool marked;              // async input pending
+    unsigned long readTimeout;
+
+    // StreamBusInterface methods
+    bool lockRequest(unsigned long lockTimeout_ms);
+    bool unlock();
+    bool writeRequest(const void* output, size_t size,
+        unsigned long writeTimeout_ms);
+    bool readRequest(unsigned long replyTimeout_ms,
+        unsigned long readTimeout_ms, ssize_t expectedLength, bool async);
+    bool supportsAsyncRead();
+    bool connectRequest(unsigned long connecttimeout_ms);
+    bool disconnectRequest();
+    void finish();
+    void printStatus(StreamBuffer& buffer);
+
+    // StreamEventLoop::Source methods
+    void timerExpired();
+
+    // called by port with mutex locked
+    void complete(StreamIoStatus status);
+
+protected:
+    StreamFdInterface(Client* client, StreamFdPort* port);
+    ~StreamFdInterface();
+
+    // for getBusInterface() of derived classes, NULL if addr >= 0
+    static StreamFdPort* findPort(const char* busname, int addr,
+        const char* type);
+};
+
+#endif
+#endif
@@ -24,6 +24,8 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <limits.h>
+#include <float.h>
+#include <math.h>
 #include "StreamFormatConverter.h"
 #include "StreamError.h"
 
@@ -239,6 +241,54 @@ scanPseudo(const StreamFormat& fmt, StreamBuffer&, size_t&)
     return -1;
 }
 
+ssize_t StreamFormatConverter::
+scanArray(const StreamFormat&, const char*, size_t, void*, size_t, size_t&)
+{
+    // no bulk scan: scan element by element
+    return -1;
+}
+
+template <size_t N>
+static void swapElements(char* p, const char* input, size_t count)
+{
+    // constant N lets the compiler unroll and vectorize this
+    size_t i, j;
+    for (i = 0; i < count; i++)
+    {
+        for (j = 0; j < N; j++)
+            p[j] = input[N-1-j];
+        p += N;
+        input += N;
+    }
+}
+
+void StreamFormatConverter::
+copyElements(void* values, const char* input, size_t size, size_t count,
+    bool littleEndian)
+{
+    static const union {short s; char c[sizeof(short)];} u = {1};
+    char* p = static_cast<char*>(values);
+
+    if (size == 1 || littleEndian == (u.c[0] != 0))
+    {
+        // byte order matches
+        memcpy(p, input, size * count);
+        return;
+    }
+    switch (size)
+    {
+        case 2:
+            swapElements<2>(p, input, count);
+            break;
+        case 4:
+            swapElements<4>(p, input, count);
+            break;
+        case 8:
+            swapElements<8>(p, input, count);
+            break;
+    }
+}
+
 static void copyFormatString(StreamBuffer& info, const char* source)
 {
     const char* p = source - 1;
@@ -257,25 +307,26 @@ static void copyFormatString(StreamBuffer& info, const char* source)
 
 // Standard Long Converter for 'diouxX'
 
-static ssize_t prepareval(const StreamFormat& fmt, const char*& input, bool& neg)
+// Skip whitespace and sign. Return number of skipped chars.
+// Set len to the number of chars still allowed by the width field.
+static ssize_t prepareval(const StreamFormat& fmt, const char*& input, bool& neg,
+    size_t& len)
 {
     size_t consumed = 0;
     neg = false;
+    len = (size_t)-1; // no limit
     while (isspace(*input)) { input++; consumed++; }
     if (fmt.width)
     {
-        // take local copy because strto* don't have width parameter
-        size_t width = fmt.width;
+        len = fmt.width;
         if (fmt.flags & space_flag)
         {
             // normally whitespace does not count to width
             // but do so if space flag is present
-            width -= consumed;
+            len -= consumed;
         }
-        strncpy((char*)fmt.info, input, width);
-        ((char*)fmt.info)[width] = 0;
-        input = fmt.info;
     }
+    if (!len) return consumed;
     if (*input == '+')
     {
         goto skipsign;
@@ -286,8 +337,9 @@ static ssize_t prepareval(const StreamFormat& fmt, const char*& input, bool& neg
 skipsign:
         input++;
         consumed++;
+        len--;
     }
-    if (isspace(*input))
+    if (len && isspace(*input))
     {
         // allow space after sign only if # flag is set
         if (!(fmt.flags & alt_flag)) return -1;
@@ -295,6 +347,53 @@ skipsign:
     return consumed;
 }
 
+// Locale independent replacement for strtoul which reads at most
+// len chars and stops at the terminating null byte.
+// Because of len, width limited input needs no copy.
+// Return number of chars used or 0 if no number was found.
+static size_t scanUnsigned(const char* input, size_t len, int base,
+    unsigned long& value)
+{
+    size_t i = 0;
+    size_t start;
+    bool neg = false;
+    bool overflow = false;
+    unsigned long v = 0;
+    unsigned int d;
+    unsigned char c;
+
+    // like strtoul, accept (another) whitespace and sign
+    while (i < len && isspace((unsigned char)input[i])) i++;
+    if (i < len && (input[i] == '+' || input[i] == '-'))
+        neg = input[i++] == '-';
+    if ((base == 0 || base == 16) && i+2 < len && input[i] == '0'
+        && (input[i+1] == 'x' || input[i+1] == 'X')
+        && isxdigit((unsigned char)input[i+2]))
+    {
+        base = 16;
+        i += 2;
+    }
+    else if (base == 0)
+    {
+        base = (i < len && input[i] == '0') ? 8 : 10;
+    }
+    for (start = i; i < len; i++)
+    {
+        c = input[i];
+        if (c >= '0' && c <= '9') d = c - '0';
+        else if (c >= 'a' && c <= 'z') d = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'Z') d = c - 'A' + 10;
+        else break;
+        if (d >= (unsigned int)base) break;
+        if (v > (~0UL - d) / base) overflow = true;
+        v = v * base + d;
+    }
+    if (i == start) return 0;
+    // strtoul returns ULONG_MAX on overflow, even for negative numbers
+    value = overflow ? ~0UL : neg ? -v : v;
+    return i;
+}
+
 class StdLongConverter : public StreamFormatConverter
 {
     int parse(const StreamFormat& fmt, StreamBuffer& output, const char*& value, bool scanFormat);
@@ -312,11 +411,7 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
             fmt.prec, fmt.conv);
         return false;
     }
-    if (scanFormat)
-    {
-        if (fmt.width) info.reserve(fmt.width+1);
-    }
-    else
+    if (!scanFormat)
     {
         copyFormatString(info, source);
         info.append('l');
@@ -341,13 +436,13 @@ printLong(const StreamFormat& fmt, StreamBuffer& output, long value)
 ssize_t StdLongConverter::
 scanLong(const StreamFormat& fmt, const char* input, long& value)
 {
-    char* end;
     ssize_t consumed;
     bool neg;
     int base;
-    long v;
+    size_t len;
+    unsigned long v;
 
-    consumed = prepareval(fmt, input, neg);
+    consumed = prepareval(fmt, input, neg, len);
     if (consumed < 0) return -1;
     switch (fmt.conv)
     {
@@ -368,10 +463,10 @@ scanLong(const StreamFormat& fmt, const char* input, long& value)
         default:
             base = 0;
     }
-    v = strtoul(input, &end, base);
-    if (end == input) return -1;
-    consumed += end-input;
-    value = neg ? -v : v;
+    len = scanUnsigned(input, len, base, v);
+    if (!len) return -1;
+    consumed += len;
+    value = neg ? -(long)v : (long)v;
     return consumed;
 }
 
@@ -379,6 +474,262 @@ RegisterConverter (StdLongConverter, "diouxX");
 
 // Standard Double Converter for 'feEgG'
 
+// Double arithmetic without excess precision (no x87) allows to
+// calculate some results exactly as strtod and printf do.
+#if (defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0) || \
+    (defined(__FLT_EVAL_METHOD__) && __FLT_EVAL_METHOD__ == 0)
+#define EXACT_DOUBLE_MATH
+// all powers of 10 which are exact in a double
+static const double exactPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+#endif
+
+// Parse a plain decimal number like strtod if that is possible exactly
+// (Clinger's fast path): With up to 15 significant digits the mantissa
+// is exact in a double, and so is a power of 10 up to 1e22. Then one
+// multiplication or division gives the same correctly rounded result
+// as strtod. Return number of chars used or 0 if strtod is needed.
+static size_t fastScanDouble(const char* input, size_t len, double& value)
+{
+#ifdef EXACT_DOUBLE_MATH
+    size_t i = 0;
+    double m = 0;       // significant digits without trailing zeros
+    int digits = 0;     // number of digits in m
+    int zeros = 0;      // trailing zeros not yet in m
+    int exp = 0;
+    bool point = false;
+    bool found = false;
+    unsigned char c;
+
+    // hex numbers, inf, nan, etc. are left to strtod
+    if (len > 1 && input[0] == '0' && (input[1] == 'x' || input[1] == 'X'))
+        return 0;
+    for (; i < len; i++)
+    {
+        c = input[i];
+        if (c == '.' && !point)
+        {
+            point = true;
+            continue;
+        }
+        if (c < '0' || c > '9') break;
+        found = true;
+        if (point) exp--;
+        if (c == '0')
+        {
+            if (digits) zeros++;
+            continue;
+        }
+        if (digits + zeros + 1 > 15) return 0;
+        m = m * exactPow10[zeros + 1] + (c - '0');
+        digits += zeros + 1;
+        zeros = 0;
+    }
+    if (!found) return 0;
+    exp += zeros;
+    if (i + 1 < len && (input[i] == 'e' || input[i] == 'E'))
+    {
+        size_t j = i + 1;
+        bool negexp = false;
+        int e = 0;
+        if (input[j] == '+' || input[j] == '-')
+            negexp = input[j++] == '-';
+        if (j < len && input[j] >= '0' && input[j] <= '9')
+        {
+            while (j < len && input[j] >= '0' && input[j] <= '9')
+            {
+                if (e < 10000) e = e * 10 + input[j] - '0';
+                j++;
+            }
+            exp += negexp ? -e : e;
+            i = j;
+        }
+    }
+    if (digits == 0)
+    {
+        value = 0.0;
+        return i;
+    }
+    if (exp > 22 && digits + exp - 22 <= 15)
+    {
+        // move some zeros into the mantissa, still exact
+        m *= exactPow10[exp - 22];
+        exp = 22;
+    }
+    if (exp < -22 || exp > 22) return 0;
+    value = exp < 0 ? m / exactPow10[-exp] : m * exactPow10[exp];
+    return i;
+#else
+    return 0;
+#endif
+}
+
+#ifdef EXACT_DOUBLE_MATH
+// Round a*10^scale to an integer like printf does (to nearest, ties to
+// even, from the exact binary value of a).
+// Return false if double arithmetic can't decide this reliably.
+static bool roundScaled(double a, int scale, double& r)
+{
+    double y, f;
+    int e;
+
+    if (scale > 22 || scale < -22) return false;
+    y = scale >= 0 ? a * exactPow10[scale] : a / exactPow10[-scale];
+    if (y >= 4503599627370496.0) return false; // 2^52
+    f = y - floor(y);
+    frexp(y, &e);
+    // y may be wrong by half a unit in the last place
+    if (fabs(f - 0.5) <= ldexp(1.0, e - 53)) return false;
+    r = floor(y) + (f > 0.5);
+    return true;
+}
+
+// Write integer r < 2^52 with at least mindigits digits backwards
+// to end. Return pointer to first digit.
+static char* writeDigits(char* end, double r, int mindigits)
+{
+    // split into parts that fit into unsigned long
+    unsigned long hi = (unsigned long)(r / 1e9);
+    double lo = r - hi * 1e9;
+    if (lo < 0) { hi--; lo += 1e9; }
+    else if (lo >= 1e9) { hi++; lo -= 1e9; }
+    unsigned long l = (unsigned long)lo;
+    char* p = end;
+    int n = 0;
+    do {
+        *--p = '0' + l % 10;
+        l /= 10;
+        n++;
+    } while (l || (hi && n < 9));
+    while (hi)
+    {
+        *--p = '0' + hi % 10;
+        hi /= 10;
+        n++;
+    }
+    while (n < mindigits)
+    {
+        *--p = '0';
+        n++;
+    }
+    return p;
+}
+#endif
+
+// Format %f %e %E %g %G without vsnprintf if the result can be
+// calculated exactly. The output is the same as from printf.
+// Return false if vsnprintf is needed.
+static bool fastPrintDouble(const StreamFormat& fmt, StreamBuffer& output,
+    double value)
+{
+#ifdef EXACT_DOUBLE_MATH
+    char digitbuffer[32];
+    char body[48];
+    char* digits;
+    char conv;
+    bool neg;
+    double a, r;
+    long prec, fprec;
+    int x, i, n;
+    size_t len = 0;
+
+    // leave # flag, inf and nan to printf
+    if (fmt.flags & alt_flag) return false;
+    if (value - value != 0) return false;
+    neg = value < 0 || (value == 0 && 1/value < 0);
+    a = fabs(value);
+    prec = fmt.prec < 0 ? 6 : fmt.prec;
+    conv = fmt.conv;
+    if (conv == 'f')
+    {
+        if (!roundScaled(a, prec, r)) return false;
+        fprec = prec;
+    }
+    else
+    {
+        // find exponent x with 1 <= mantissa < 10 after rounding
+        if ((conv == 'g' || conv == 'G') && prec == 0) prec = 1;
+        if (conv == 'g' || conv == 'G') prec--;
+        if (prec > 14) return false;
+        x = a == 0 ? 0 : (int)floor(log10(a));
+        for (i = 0; ; i++)
+        {
+            if (i > 3) return false;
+            if (!roundScaled(a, prec - x, r)) return false;
+            if (a == 0) break;
+            if (r >= exactPow10[prec + 1]) x++;
+            else if (r < exactPow10[prec]) x--;
+            else break;
+        }
+        if ((conv == 'g' || conv == 'G') && x >= -4 && x <= prec)
+        {
+            // %f style with same digits
+            conv = 'f';
+            fprec = prec - x;
+        }
+        else fprec = -1;
+    }
+    if (fprec >= 0)
+    {
+        // r with fprec digits after the decimal point
+        digits = writeDigits(digitbuffer + sizeof(digitbuffer), r, fprec + 1);
+        n = digitbuffer + sizeof(digitbuffer) - digits;
+        memcpy(body, digits, n - fprec);
+        len = n - fprec;
+        if (fprec)
+        {
+            body[len++] = '.';
+            memcpy(body + len, digits + n - fprec, fprec);
+            len += fprec;
+        }
+        if (fmt.conv == 'g' || fmt.conv == 'G')
+        {
+            // remove trailing zeros and decimal point
+            while (fprec && body[len-1] == '0') { len--; fprec--; }
+            if (!fprec && body[len-1] == '.') len--;
+        }
+    }
+    else
+    {
+        // r with prec+1 digits as d.ddde+xx
+        digits = writeDigits(digitbuffer + sizeof(digitbuffer), r, prec + 1);
+        body[len++] = digits[0];
+        if (prec)
+        {
+            body[len++] = '.';
+            memcpy(body + len, digits + 1, prec);
+            len += prec;
+        }
+        if (fmt.conv == 'g' || fmt.conv == 'G')
+        {
+            while (prec && body[len-1] == '0') { len--; prec--; }
+            if (!prec && body[len-1] == '.') len--;
+        }
+        body[len++] = (conv == 'E' || conv == 'G') ? 'E' : 'e';
+        body[len++] = x < 0 ? '-' : '+';
+        digits = writeDigits(digitbuffer + sizeof(digitbuffer), x < 0 ? -x : x, 2);
+        n = digitbuffer + sizeof(digitbuffer) - digits;
+        memcpy(body + len, digits, n);
+        len += n;
+    }
+
+    // sign and padding
+    char sign = neg ? '-' : fmt.flags & sign_flag ? '+' :
+        fmt.flags & space_flag ? ' ' : 0;
+    size_t total = len + (sign != 0);
+    size_t pad = fmt.width > total ? fmt.width - total : 0;
+    if (pad && !(fmt.flags & (left_flag|zero_flag))) output.append(' ', pad);
+    if (sign) output.append(sign);
+    if (pad && (fmt.flags & (left_flag|zero_flag)) == zero_flag) output.append('0', pad);
+    output.append(body, len);
+    if (pad && (fmt.flags & left_flag)) output.append(' ', pad);
+    return true;
+#else
+    return false;
+#endif
+}
+
 class StdDoubleConverter : public StreamFormatConverter
 {
     virtual int parse(const StreamFormat&, StreamBuffer&, const char*&, bool);
@@ -396,11 +747,7 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
             fmt.prec, fmt.conv);
         return false;
     }
-    if (scanFormat)
-    {
-        if (fmt.width) info.reserve(fmt.width+1);
-    }
-    else
+    if (!scanFormat)
     {
         copyFormatString(info, source);
         info.append(fmt.conv);
@@ -411,7 +758,8 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
 bool StdDoubleConverter::
 printDouble(const StreamFormat& fmt, StreamBuffer& output, double value)
 {
-    output.print(fmt.info, value);
+    if (!fastPrintDouble(fmt, output, value))
+        output.print(fmt.info, value);
     return true;
 }
 
@@ -421,9 +769,23 @@ scanDouble(const StreamFormat& fmt, const char* input, double& value)
     char* end;
     ssize_t consumed;
     bool neg;
+    size_t len;
+    StreamBuffer copy;
 
-    consumed = prepareval(fmt, input, neg);
+    consumed = prepareval(fmt, input, neg, len);
     if (consumed < 0) return -1;
+    size_t n = fastScanDouble(input, len, value);
+    if (n)
+    {
+        if (neg) value = -value;
+        return consumed + n;
+    }
+    if (fmt.width)
+    {
+        // take local copy because strtod has no width parameter
+        while (n < len && input[n]) n++;
+        input = copy.set(input, n)();
+    }
     value = strtod(input, &end);
     if (neg) value = -value;
     if (end == input) return -1;
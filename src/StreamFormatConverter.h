@@ -67,6 +67,12 @@ public:
         const char* input, char* value, size_t& size);
     virtual ssize_t scanPseudo(const StreamFormat& fmt,
         StreamBuffer& inputLine, size_t& cursor);
+    virtual ssize_t scanArray(const StreamFormat& fmt,
+        const char* input, size_t length,
+        void* values, size_t size, size_t& count);
+protected:
+    static void copyElements(void* values, const char* input,
+        size_t size, size_t count, bool littleEndian);
 };
 
 inline StreamFormatConverter* StreamFormatConverter::
@@ -151,6 +157,17 @@ void* ref_##converter = &registrar_##converter\
 * to update size.
 * Return -1 on failure.
 *
+* scanArray()
+* ===========
+* Optional bulk version of scanLong() or scanDouble() for arrays without
+* separator. Read up to count values from length bytes of input directly
+* into values, an array of elements with size bytes each in native byte
+* order. The elements are integers for long formats and IEEE floats for
+* double formats. Update count with the number of stored elements and
+* return the number of consumed bytes.
+* Return -1 if the format cannot be scanned this way. Then scanLong() or
+* scanDouble() is called for each element instead. This is the default.
+*
 *
 * Register your class
 * ===================
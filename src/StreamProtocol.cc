@@ -20,6 +20,7 @@
 * along with StreamDevice. If not, see https://www.gnu.org/licenses/.
 *************************************************************************/
 
+#include <errno.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -53,8 +54,39 @@ class StreamProtocolParser::Protocol::Variable
 
 StreamProtocolParser* StreamProtocolParser::parsers = NULL;
 const char* StreamProtocolParser::path = ".";
+const char* StreamProtocolParser::cachedir = NULL;
+const char* StreamProtocolParser::cachetag = "";
 static const char* specialChars = " ,;{}=()$'\"+-*/";
 
+// Increment when the format of parsed protocols changes
+static const char cacheMagic[] = "StreamDevice protocol cache 1\n";
+
+static void putCacheString(StreamBuffer& cache, const StreamBuffer& s)
+{
+    size_t len = s.length();
+    cache.append(&len, sizeof(len));
+    cache.append(s);
+}
+
+static bool getCacheString(const char*& data, const char* end, StreamBuffer& s)
+{
+    size_t len;
+    if ((size_t)(end - data) < sizeof(len)) return false;
+    len = extract<size_t>(data);
+    if ((size_t)(end - data) < len) return false;
+    s.set(data, len);
+    data += len;
+    return true;
+}
+
+template<class T>
+static bool getCacheValue(const char*& data, const char* end, T& value)
+{
+    if ((size_t)(end - data) < sizeof(T)) return false;
+    value = extract<T>(data);
+    return true;
+}
+
 // Client destructor
 StreamProtocolParser::Client::
 ~Client()
@@ -76,6 +108,33 @@ StreamProtocolParser(FILE* file, const char* filename)
     valid = parseProtocol(globalSettings, globalSettings.commands);
 }
 
+// Private constructor for cached protocol files
+// Not linked into the parsers list. Check valid before doing so.
+StreamProtocolParser::
+StreamProtocolParser(const char* filename, const char*& data, const char* end)
+    : filename(filename), file(NULL), globalSettings(filename)
+{
+    next = NULL;
+    protocols = NULL;
+    line = 0;
+    quote = false;
+    valid = false;
+    if (!globalSettings.readCache(data, end)) return;
+    Protocol** ppP = &protocols;
+    while (data < end && *data == 'p')
+    {
+        StreamBuffer name;
+        int startline;
+        data++;
+        if (!getCacheString(data, end, name)) return;
+        if (!getCacheValue(data, end, startline)) return;
+        *ppP = new Protocol(name, startline, filename);
+        if (!(*ppP)->readCache(data, end)) return;
+        ppP = &(*ppP)->next;
+    }
+    valid = data + 1 == end && *data == '.';
+}
+
 // Private destructor
 StreamProtocolParser::
 ~StreamProtocolParser()
@@ -188,10 +247,49 @@ readFile(const char* filename)
         file = fopen(dir(), "r");
         if (file)
         {
+            StreamBuffer cachefile;
+            StreamBuffer key;
+            if (cachedir)
+            {
+                // key: cache format, tag, path, size and checksum of file
+                unsigned long size = 0;
+                unsigned long hash = 2166136261UL; // FNV-1a
+                char chunk[4096];
+                size_t i, len;
+                while ((len = fread(chunk, 1, sizeof(chunk), file)) > 0)
+                {
+                    for (i = 0; i < len; i++)
+                        hash = ((hash ^ (unsigned char)chunk[i]) * 16777619UL)
+                            & 0xFFFFFFFFUL;
+                    size += len;
+                }
+                rewind(file);
+                key.append(cacheMagic);
+                // detect different data sizes and byte order
+                int one = 1;
+                key.append((char)sizeof(size_t)).append(&one, sizeof(one));
+                key.append(cachetag).append('\0');
+                key.append(dir).append('\0');
+                key.append(&size, sizeof(size));
+                key.append(&hash, sizeof(hash));
+                cachefile.append(cachedir);
+                if (cachefile && cachefile[-1] != dirseparator)
+                    cachefile.append(dirseparator);
+                for (i = 0; i < dir.length(); i++)
+                    cachefile.append(isalnum((unsigned char)dir[i]) ? dir[i] : '_');
+                cachefile.append(".cache");
+                parser = readCache(filename, cachefile, key);
+                if (parser)
+                {
+                    fclose(file);
+                    return parser;
+                }
+            }
             // file found; create a parser to read it
             parser = new StreamProtocolParser(file, filename);
             fclose(file);
             if (!parser->valid) return NULL;
+            if (cachedir) parser->writeCache(cachefile, key);
 //             printf(
 // "/---------------------------------------------------------------------\\\n");
 //             parser->report();
@@ -204,6 +302,96 @@ readFile(const char* filename)
     return NULL;
 }
 
+// Read a parsed protocol file from cache if the key matches
+StreamProtocolParser* StreamProtocolParser::
+readCache(const char* filename, const StreamBuffer& cachefile,
+    const StreamBuffer& key)
+{
+    FILE* file;
+    StreamBuffer cache;
+    size_t n;
+
+    file = fopen(cachefile(), "rb");
+    if (!file)
+    {
+        debug("StreamProtocolParser::readCache: no cache file '%s'\n",
+            cachefile());
+        return NULL;
+    }
+    do {
+        n = fread(cache.reserve(4096), 1, 4096, file);
+        cache.truncate(cache.length() - 4096 + n);
+    } while (n > 0);
+    fclose(file);
+    if (!cache.startswith(key(), key.length()))
+    {
+        debug("StreamProtocolParser::readCache: cache file '%s' is stale\n",
+            cachefile());
+        return NULL;
+    }
+    const char* data = cache(key.length());
+    StreamProtocolParser* parser =
+        new StreamProtocolParser(filename, data, cache.end());
+    if (!parser->valid)
+    {
+        error("Ignoring corrupt protocol cache file '%s'\n", cachefile());
+        delete parser;
+        return NULL;
+    }
+    debug("StreamProtocolParser::readCache: '%s' read from cache file '%s'\n",
+        filename, cachefile());
+    parser->next = parsers;
+    parsers = parser;
+    return parser;
+}
+
+// Write parsed protocol file to cache
+// Write to a temporary file first to leave no partial cache file behind
+void StreamProtocolParser::
+writeCache(const StreamBuffer& cachefile, const StreamBuffer& key)
+{
+    FILE* file;
+    StreamBuffer cache = key;
+    StreamBuffer tmpfile = cachefile;
+    Protocol* p;
+
+    globalSettings.writeCache(cache);
+    for (p = protocols; p; p = p->next)
+    {
+        cache.append('p');
+        putCacheString(cache, p->protocolname);
+        cache.append(&p->line, sizeof(p->line));
+        p->writeCache(cache);
+    }
+    cache.append('.');
+    tmpfile.append(".tmp");
+    file = fopen(tmpfile(), "wb");
+    if (!file || fwrite(cache(), 1, cache.length(), file) != cache.length())
+    {
+        error("Can't write protocol cache file '%s': %s\n",
+            tmpfile(), strerror(errno));
+        if (file)
+        {
+            fclose(file);
+            remove(tmpfile());
+        }
+        return;
+    }
+    fclose(file);
+#ifdef _WIN32
+    remove(cachefile());
+#endif
+    if (rename(tmpfile(), cachefile()) != 0)
+    {
+        error("Can't rename protocol cache file '%s' to '%s': %s\n",
+            tmpfile(), cachefile(), strerror(errno));
+        remove(tmpfile());
+        return;
+    }
+    debug("StreamProtocolParser::writeCache: '%s' written to cache file '%s'\n",
+        filename(), cachefile());
+}
+
 /*
 STEP 2: Compile protocols to executable format
 
@@ -699,6 +887,32 @@ format:         {
                     s += f.infolen;
                 }
                 continue;
+            case literal:
+            {
+                // <literal> length bytes
+                unsigned short len;
+                s++;
+                len = extract<unsigned short>(s);
+                while (len--)
+                {
+                    char c = *s++;
+                    if (c == '"' || c == '\\')
+                        buffer.append('\\').append(c);
+                    else if (c == '\r')
+                        buffer.append("\\r");
+                    else if (c == '\n')
+                        buffer.append("\\n");
+                    else if ((c & 0x7f) < 0x20 || (c & 0x7f) == 0x7f)
+                        buffer.print("\\x%02x", c & 0xff);
+                    else
+                        buffer.append(c);
+                }
+                continue;
+            }
+            case min_length:
+                // <min_length> length pseudo (nothing to print)
+                s += 2 + sizeof(unsigned short);
+                continue;
             default:
                 if ((*s & 0x7f) < 0x20 || (*s & 0x7f) == 0x7f)
                     buffer.print("\\x%02x", *s & 0xff);
@@ -783,6 +997,60 @@ Protocol(const Protocol& p, StreamBuffer& name, int _line)
     }
 }
 
+// for protocols read from cache, variables follow in readCache()
+StreamProtocolParser::Protocol::
+Protocol(const StreamBuffer& name, int _line, const char* filename)
+    : protocolname(name), filename(filename)
+{
+    next = NULL;
+    variables = NULL;
+    commands = NULL;
+    line = _line;
+    memset(parameter, 0, sizeof(parameter));
+    parameter[0] = protocolname();
+}
+
+void StreamProtocolParser::Protocol::
+writeCache(StreamBuffer& cache)
+{
+    Variable* pV;
+    for (pV = variables; pV; pV = pV->next)
+    {
+        cache.append('v');
+        putCacheString(cache, pV->name);
+        putCacheString(cache, pV->value);
+        cache.append(&pV->line, sizeof(pV->line));
+    }
+    cache.append(';');
+}
+
+bool StreamProtocolParser::Protocol::
+readCache(const char*& data, const char* end)
+{
+    Variable** ppV;
+    StreamBuffer name;
+    int varline;
+
+    delete variables;
+    variables = NULL;
+    commands = NULL;
+    ppV = &variables;
+    while (data < end && *data == 'v')
+    {
+        data++;
+        if (!getCacheString(data, end, name)) return false;
+        *ppV = new Variable(name ? name() : NULL, 0);
+        if (!getCacheString(data, end, (*ppV)->value)) return false;
+        if (!getCacheValue(data, end, varline)) return false;
+        (*ppV)->line = varline;
+        ppV = &(*ppV)->next;
+    }
+    if (!variables || data >= end || *data++ != ';') return false;
+    // first variable holds the commands
+    commands = &variables->value;
+    return true;
+}
+
 StreamProtocolParser::Protocol::
 ~Protocol()
 {
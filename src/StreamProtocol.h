@@ -35,7 +35,8 @@ class StreamProtocolParser
 public:
 
     ENUM (Codes,
-        eos, skip, whitespace, format, format_field, last_function_code);
+        eos, skip, whitespace, format, format_field, literal, min_length,
+        last_function_code);
 
     class Client;
 
@@ -55,6 +56,9 @@ public:
 
         Protocol(const char* filename);
         Protocol(const Protocol& p, StreamBuffer& name, int line);
+        Protocol(const StreamBuffer& name, int line, const char* filename);
+        void writeCache(StreamBuffer& cache);
+        bool readCache(const char*& data, const char* end);
         StreamBuffer* createVariable(const char* name, int line);
         bool compileFormat(StreamBuffer&, const char*& source,
             FormatType, Client*);
@@ -109,10 +113,15 @@ private:
     bool valid;
 
     StreamProtocolParser(FILE* file, const char* filename);
+    StreamProtocolParser(const char* filename, const char*& data,
+        const char* end);
     Protocol* getProtocol(const StreamBuffer& protocolAndParams);
     bool isGlobalContext(const StreamBuffer* commands);
     bool isHandlerContext(Protocol&, const StreamBuffer* commands);
     static StreamProtocolParser* readFile(const char* file);
+    static StreamProtocolParser* readCache(const char* filename,
+        const StreamBuffer& cachefile, const StreamBuffer& key);
+    void writeCache(const StreamBuffer& cachefile, const StreamBuffer& key);
     bool parseProtocol(Protocol&, StreamBuffer* commands);
     int readChar();
     bool readToken(StreamBuffer& buffer,
@@ -128,6 +137,8 @@ public:
         const StreamBuffer& protocolAndParams);
     static void free();
     static const char* path;
+    static const char* cachedir;
+    static const char* cachetag;
     static const char* printString(StreamBuffer&, const char* string);
     void report();
 };
@@ -157,6 +168,11 @@ PURPOSE: read protocol from file, create parser if necessary
 RETURNS: a copy of a protocol that must be deleted by the caller
 SIDEEFFECTS: file IO, memory allocation for parser
 
+NAME: cachedir
+PURPOSE: directory for cached parsed protocol files (NULL: no caching)
+Cache files are keyed by path, size and checksum of the protocol file
+and by cachetag (e.g. the StreamDevice version).
+
 NAME: free()
 PURPOSE: free all parser resources allocated by getProtocol()
 Call this function once after the last getProtocol() to clean up.
@@ -0,0 +1,243 @@
+/*************************************************************************
+* This is the native TCP bus interface for StreamDevice.
+* Please see ../docs/ for detailed documentation.
+*
+* This file is part of StreamDevice.
+*
+* StreamDevice is free software: You can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* StreamDevice is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with StreamDevice. If not, see https://www.gnu.org/licenses/.
+*************************************************************************/
+
+#include <stdio.h>
+#include "StreamFdPort.h"
+
+#ifdef WITH_EVENTLOOP
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#include "iocsh.h"
+#include "StreamBusInterface.h"
+#include "StreamError.h"
+#include "StreamBuffer.h"
+#include "epicsExport.h"
+
+#ifdef WITH_EVENTLOOP
+
+// streamTcpConfigure "port", "host:port" creates a TcpPort.
+// All I/O is done by StreamFdPort, this only connects the socket.
+
+static const unsigned long ConnectTimeout = 5000;
+
+class TcpPort : StreamFdPort
+{
+    struct sockaddr_storage address;
+    socklen_t addresslen;
+
+    TcpPort(const char* name, const char* hostInfo,
+        const struct sockaddr* address, socklen_t addresslen);
+
+    // StreamFdPort methods
+    void open();
+    void openReady();
+    ssize_t writeBytes(const void* output, size_t size);
+
+public:
+    static long configure(const char* name, const char* hostInfo);
+};
+
+class TcpInterface : StreamFdInterface
+{
+    TcpInterface(Client* client, StreamFdPort* port) :
+        StreamFdInterface(client, port) {}
+
+public:
+    // static creator method
+    static StreamBusInterface* getBusInterface(Client* client,
+        const char* busname, int addr, const char* param);
+};
+
+RegisterStreamBusInterface(TcpInterface);
+
+TcpPort::
+TcpPort(const char* name, const char* hostInfo,
+    const struct sockaddr* _address, socklen_t _addresslen) :
+    StreamFdPort("tcp", name, hostInfo)
+{
+    memcpy(&address, _address, _addresslen);
+    addresslen = _addresslen;
+}
+
+long TcpPort::
+configure(const char* name, const char* hostInfo)
+{
+    char host[256];
+    const char* hostname = hostInfo;
+    const char* service;
+    struct addrinfo hints;
+    struct addrinfo* result;
+    size_t len;
+    int status;
+
+    if (!name || !hostInfo)
+    {
+        fprintf(stderr,
+            "Usage: streamTcpConfigure \"portname\", \"host:port\"\n");
+        return -1;
+    }
+    if (find(name))
+    {
+        fprintf(stderr, "streamTcpConfigure: port %s already exists\n",
+            name);
+        return -1;
+    }
+    // host:port or [ipv6]:port, anything after a space is ignored
+    service = strrchr(hostInfo, ':');
+    if (!service || service == hostInfo)
+    {
+        fprintf(stderr, "streamTcpConfigure: %s: expect \"host:port\"\n",
+            hostInfo);
+        return -1;
+    }
+    len = service - hostInfo;
+    if (hostInfo[0] == '[' && service[-1] == ']')
+    {
+        hostname++;
+        len -= 2;
+    }
+    if (len >= sizeof(host)) len = sizeof(host) - 1;
+    memcpy(host, hostname, len);
+    host[len] = 0;
+    service++;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    status = getaddrinfo(host, StreamBuffer(service, strcspn(service, " "))(),
+        &hints, &result);
+    if (status != 0)
+    {
+        fprintf(stderr, "streamTcpConfigure: %s: %s\n",
+            host, gai_strerror(status));
+        return -1;
+    }
+    TcpPort* port = new TcpPort(name, hostInfo, result->ai_addr,
+        result->ai_addrlen);
+    freeaddrinfo(result);
+    port->start();
+    return 0;
+}
+
+void TcpPort::
+open()
+{
+    fd = socket(address.ss_family,
+        SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        openFailed(errno);
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (::connect(fd, (struct sockaddr*)&address, addresslen) == 0)
+    {
+        opened();
+        return;
+    }
+    if (errno != EINPROGRESS)
+    {
+        openFailed(errno);
+        return;
+    }
+    state = Connecting;
+    watch(fd, EPOLLOUT);
+    startTimer(ConnectTimeout);
+    // continues with openReady() or timeout
+}
+
+void TcpPort::
+openReady()
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err) openFailed(err);
+    else opened();
+}
+
+ssize_t TcpPort::
+writeBytes(const void* output, size_t size)
+{
+    // no SIGPIPE if the peer has closed the connection
+    return send(fd, output, size, MSG_NOSIGNAL|MSG_DONTWAIT);
+}
+
+StreamBusInterface* TcpInterface::
+getBusInterface(Client* client,
+    const char* busname, int addr, const char*)
+{
+    StreamFdPort* port = findPort(busname, addr, "tcp");
+    if (!port) return NULL;
+    TcpInterface* interface = new TcpInterface(client, port);
+    debug ("TcpInterface::getBusInterface(%s, %d): "
+        "new interface allocated\n",
+        busname, addr);
+    return interface;
+}
+
+extern "C" long streamTcpConfigure(const char* portname,
+    const char* hostInfo)
+{
+    return TcpPort::configure(portname, hostInfo);
+}
+
+#else
+
+// No epoll on this system. Records cannot find any port.
+void* ref_TcpInterface = NULL;
+
+extern "C" long streamTcpConfigure(const char*, const char*)
+{
+    fprintf(stderr, "streamTcpConfigure: not supported on this system\n");
+    return -1;
+}
+
+#endif
+
+static const iocshArg streamTcpConfigureArg0 =
+    { "portname", iocshArgString };
+static const iocshArg streamTcpConfigureArg1 =
+    { "host:port", iocshArgString };
+static const iocshArg * const streamTcpConfigureArgs[] =
+    { &streamTcpConfigureArg0, &streamTcpConfigureArg1 };
+static const iocshFuncDef streamTcpConfigureDef =
+    { "streamTcpConfigure", 2, streamTcpConfigureArgs };
+
+void streamTcpConfigureFunc(const iocshArgBuf *args)
+{
+    streamTcpConfigure(args[0].sval, args[1].sval);
+}
+
+static void TcpInterfaceRegistrar ()
+{
+     iocshRegister(&streamTcpConfigureDef, streamTcpConfigureFunc);
+}
+
+extern "C" {
+epicsExportRegistrar(TcpInterfaceRegistrar);
+}
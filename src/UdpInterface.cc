@@ -0,0 +1,645 @@
+/*************************************************************************
+* This is the native UDP bus interface for StreamDevice.
+* Please see ../docs/ for detailed documentation.
+*
+* This file is part of StreamDevice.
+*
+* StreamDevice is free software: You can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* StreamDevice is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with StreamDevice. If not, see https://www.gnu.org/licenses/.
+*************************************************************************/
+
+#include <stdio.h>
+#include "StreamFdPort.h"
+
+#ifdef WITH_EVENTLOOP
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#endif
+
+#include "iocsh.h"
+#include "StreamBusInterface.h"
+#include "StreamError.h"
+#include "StreamBuffer.h"
+#include "epicsExport.h"
+
+#ifdef WITH_EVENTLOOP
+
+/* How things are implemented:
+
+streamUdpConfigure "port", "host:port", localport creates a UdpPort.
+All ports with the same address family and local port share one
+UdpSocket, thus one event loop thread serves all of them.
+
+The socket receives up to Batch datagrams with one recvmmsg() and
+passes each to the port of its sender, found in a hash table.
+Datagrams from unknown senders are dropped.
+For StreamFdPort, each datagram is a complete message (StreamIoEnd),
+thus no terminator is needed.
+
+Datagrams written by callbacks while the socket handles a batch
+(i.e. replies and new requests in the loop thread) are collected and
+sent with one sendmmsg() after the batch. Other threads send at once.
+If the socket buffer is full, datagrams wait until it is writable.
+If even the queue is full, the port keeps its output and retries when
+the socket has sent some of the queue.
+*/
+
+static const int Batch = 32;
+static const size_t MaxDatagram = 8192;
+static const unsigned int HashSize = 1024;
+static const int ReceiveBufferSize = 1 << 20;
+
+class UdpPort;
+
+class UdpSocket : StreamEventLoop::Source
+{
+    static UdpSocket* first;
+    UdpSocket* next;
+    int family;
+    unsigned short localport;
+    int fd;
+    epicsMutex mutex;
+    UdpPort* peers[HashSize];
+    bool dispatching;         // loop thread handles a batch
+    bool waitWritable;
+    bool full;                // a port waits for space in the queue
+    // received batch
+    struct mmsghdr rmsg[Batch];
+    struct iovec riov[Batch];
+    struct sockaddr_storage raddr[Batch];
+    UdpPort* rport[Batch];
+    char* rbuf;
+    // send queue
+    int queued;
+    struct mmsghdr smsg[Batch];
+    struct iovec siov[Batch];
+    struct sockaddr_storage saddr[Batch];
+    socklen_t saddrlen[Batch];
+    size_t slen[Batch];
+    StreamBuffer sbuf;
+    unsigned long batches;
+    unsigned long received;
+    unsigned long unknown;
+    unsigned long truncated;
+    unsigned long sendBatches;
+    unsigned long sent;
+    unsigned long dropped;
+
+    UdpSocket(int family, unsigned short localport, int fd);
+    void flush();
+
+    // StreamEventLoop::Source methods
+    void ioReady(unsigned int events);
+    void timerExpired();
+
+public:
+    static UdpSocket* get(int family, unsigned short localport);
+    StreamEventLoop* eventLoop() { return loop; }
+    void addPeer(UdpPort* port);
+    UdpPort* findPeer(const struct sockaddr* address);
+    ssize_t send(const struct sockaddr* address, socklen_t addresslen,
+        const void* data, size_t size);
+    void printStatus(StreamBuffer& buffer);
+};
+
+class UdpPort : StreamFdPort
+{
+    friend class UdpSocket;
+
+    UdpSocket* socket;
+    UdpPort* nextPeer;
+    struct sockaddr_storage address;
+    socklen_t addresslen;
+
+    UdpPort(const char* name, const char* hostInfo, UdpSocket* socket,
+        const struct sockaddr* address, socklen_t addresslen);
+
+    void receive(const char* data, size_t size);
+
+    // StreamFdPort methods
+    void open();
+    ssize_t writeBytes(const void* output, size_t size);
+    void printStatus(StreamBuffer& buffer);
+
+public:
+    static long configure(const char* name, const char* hostInfo,
+        int localport);
+};
+
+class UdpInterface : StreamFdInterface
+{
+    UdpInterface(Client* client, StreamFdPort* port) :
+        StreamFdInterface(client, port) {}
+
+public:
+    // static creator method
+    static StreamBusInterface* getBusInterface(Client* client,
+        const char* busname, int addr, const char* param);
+};
+
+RegisterStreamBusInterface(UdpInterface);
+
+static unsigned int
+peerHash(const struct sockaddr* address)
+{
+    const unsigned char* p;
+    size_t len;
+    unsigned int hash = 2166136261u;
+
+    if (address->sa_family == AF_INET6)
+    {
+        const struct sockaddr_in6* a = (const struct sockaddr_in6*)address;
+        hash ^= a->sin6_port;
+        p = a->sin6_addr.s6_addr;
+        len = sizeof(a->sin6_addr.s6_addr);
+    }
+    else
+    {
+        const struct sockaddr_in* a = (const struct sockaddr_in*)address;
+        hash ^= a->sin_port;
+        p = (const unsigned char*)&a->sin_addr.s_addr;
+        len = sizeof(a->sin_addr.s_addr);
+    }
+    while (len--) hash = (hash ^ *p++) * 16777619u;
+    return hash % HashSize;
+}
+
+static bool
+samePeer(const struct sockaddr* a, const struct sockaddr* b)
+{
+    if (a->sa_family != b->sa_family) return false;
+    if (a->sa_family == AF_INET6)
+    {
+        const struct sockaddr_in6* a6 = (const struct sockaddr_in6*)a;
+        const struct sockaddr_in6* b6 = (const struct sockaddr_in6*)b;
+        return a6->sin6_port == b6->sin6_port &&
+            memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+    }
+    const struct sockaddr_in* a4 = (const struct sockaddr_in*)a;
+    const struct sockaddr_in* b4 = (const struct sockaddr_in*)b;
+    return a4->sin_port == b4->sin_port &&
+        a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+}
+
+UdpSocket* UdpSocket::first;
+
+UdpSocket::
+UdpSocket(int family, unsigned short localport, int fd) :
+    StreamEventLoop::Source(StreamEventLoop::get()),
+    family(family), localport(localport), fd(fd)
+{
+    int i;
+
+    memset(peers, 0, sizeof(peers));
+    dispatching = false;
+    waitWritable = false;
+    full = false;
+    queued = 0;
+    batches = 0;
+    received = 0;
+    unknown = 0;
+    truncated = 0;
+    sendBatches = 0;
+    sent = 0;
+    dropped = 0;
+    rbuf = new char[Batch * MaxDatagram];
+    memset(rmsg, 0, sizeof(rmsg));
+    memset(smsg, 0, sizeof(smsg));
+    for (i = 0; i < Batch; i++)
+    {
+        riov[i].iov_base = rbuf + i * MaxDatagram;
+        riov[i].iov_len = MaxDatagram;
+        rmsg[i].msg_hdr.msg_name = &raddr[i];
+        rmsg[i].msg_hdr.msg_iov = &riov[i];
+        rmsg[i].msg_hdr.msg_iovlen = 1;
+        smsg[i].msg_hdr.msg_name = &saddr[i];
+        smsg[i].msg_hdr.msg_iov = &siov[i];
+        smsg[i].msg_hdr.msg_iovlen = 1;
+    }
+    next = first;
+    first = this;
+    watch(fd, EPOLLIN);
+}
+
+// Sockets live until the IOC exits.
+UdpSocket* UdpSocket::
+get(int family, unsigned short localport)
+{
+    UdpSocket* socket;
+    int fd;
+
+    for (socket = first; socket; socket = socket->next)
+    {
+        if (socket->family == family && socket->localport == localport)
+            return socket;
+    }
+    fd = ::socket(family, SOCK_DGRAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        fprintf(stderr, "streamUdpConfigure: cannot create socket: %s\n",
+            strerror(errno));
+        return NULL;
+    }
+    // bursts of datagrams from many devices
+    int size = ReceiveBufferSize;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    struct sockaddr_storage local;
+    memset(&local, 0, sizeof(local));
+    local.ss_family = family;
+    if (family == AF_INET6)
+        ((struct sockaddr_in6*)&local)->sin6_port = htons(localport);
+    else
+        ((struct sockaddr_in*)&local)->sin_port = htons(localport);
+    if (bind(fd, (struct sockaddr*)&local, family == AF_INET6 ?
+        sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in)) != 0)
+    {
+        fprintf(stderr, "streamUdpConfigure: cannot bind to port %d: %s\n",
+            localport, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    return new UdpSocket(family, localport, fd);
+}
+
+void UdpSocket::
+addPeer(UdpPort* port)
+{
+    unsigned int hash = peerHash((struct sockaddr*)&port->address);
+    mutex.lock();
+    port->nextPeer = peers[hash];
+    peers[hash] = port;
+    mutex.unlock();
+}
+
+// called with mutex locked
+UdpPort* UdpSocket::
+findPeer(const struct sockaddr* address)
+{
+    UdpPort* port;
+    for (port = peers[peerHash(address)]; port; port = port->nextPeer)
+        if (samePeer((struct sockaddr*)&port->address, address)) break;
+    return port;
+}
+
+ssize_t UdpSocket::
+send(const struct sockaddr* address, socklen_t addresslen,
+    const void* data, size_t size)
+{
+    ssize_t n;
+
+    mutex.lock();
+    if (!queued && !(dispatching && inLoopThread()))
+    {
+        mutex.unlock();
+        n = sendto(fd, data, size, MSG_DONTWAIT, address, addresslen);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return n;
+        mutex.lock();
+    }
+    // queue behind older datagrams
+    if (queued == Batch) flush();
+    if (queued == Batch)
+    {
+        // the port keeps the output until writable()
+        full = true;
+        mutex.unlock();
+        errno = EAGAIN;
+        return -1;
+    }
+    memcpy(&saddr[queued], address, addresslen);
+    saddrlen[queued] = addresslen;
+    slen[queued] = size;
+    sbuf.append(data, size);
+    queued++;
+    // flushed after the batch or when writable
+    if (!dispatching || !inLoopThread()) flush();
+    mutex.unlock();
+    return size;
+}
+
+// called with mutex locked
+void UdpSocket::
+flush()
+{
+    size_t offset = 0;
+    size_t bytes = 0;
+    int i, n;
+
+    if (!queued) return;
+    for (i = 0; i < queued; i++)
+    {
+        siov[i].iov_base = sbuf(offset);
+        siov[i].iov_len = slen[i];
+        smsg[i].msg_hdr.msg_namelen = saddrlen[i];
+        offset += slen[i];
+    }
+    n = sendmmsg(fd, smsg, queued, MSG_DONTWAIT);
+    if (n < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            error("UDP socket: sendmmsg failed: %s\n", strerror(errno));
+            dropped += queued;
+            n = queued;
+        }
+        else n = 0;
+    }
+    else
+    {
+        sendBatches++;
+        sent += n;
+    }
+    for (i = 0; i < n; i++)
+        bytes += slen[i];
+    queued -= n;
+    memmove(saddr, saddr + n, queued * sizeof(saddr[0]));
+    memmove(saddrlen, saddrlen + n, queued * sizeof(saddrlen[0]));
+    memmove(slen, slen + n, queued * sizeof(slen[0]));
+    sbuf.remove(bytes);
+    if (queued != 0 && !waitWritable)
+    {
+        waitWritable = true;
+        watch(fd, EPOLLIN|EPOLLOUT);
+    }
+    else if (queued == 0 && waitWritable)
+    {
+        waitWritable = false;
+        watch(fd, EPOLLIN);
+    }
+    if (full && queued < Batch)
+    {
+        // tell the ports from the loop thread
+        full = false;
+        startTimer(0);
+    }
+}
+
+// Let waiting ports retry their output.
+void UdpSocket::
+timerExpired()
+{
+    UdpPort* heads[HashSize];
+    UdpPort* port;
+    unsigned int i;
+
+    // ports are never removed, nextPeer never changes
+    mutex.lock();
+    memcpy(heads, peers, sizeof(heads));
+    mutex.unlock();
+    for (i = 0; i < HashSize; i++)
+        for (port = heads[i]; port; port = port->nextPeer)
+            port->writable();
+}
+
+void UdpSocket::
+ioReady(unsigned int events)
+{
+    int i, n;
+
+    if (events & EPOLLOUT)
+    {
+        mutex.lock();
+        flush();
+        mutex.unlock();
+    }
+    if (!(events & (EPOLLIN|EPOLLERR))) return;
+    for (i = 0; i < Batch; i++)
+        rmsg[i].msg_hdr.msg_namelen = sizeof(raddr[i]);
+    n = recvmmsg(fd, rmsg, Batch, MSG_DONTWAIT, NULL);
+    if (n <= 0)
+    {
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            error("UDP socket: recvmmsg failed: %s\n", strerror(errno));
+        return;
+    }
+    mutex.lock();
+    batches++;
+    received += n;
+    for (i = 0; i < n; i++)
+        rport[i] = findPeer((struct sockaddr*)&raddr[i]);
+    dispatching = true;
+    mutex.unlock();
+    for (i = 0; i < n; i++)
+    {
+        if (!rport[i])
+        {
+            mutex.lock();
+            unknown++;
+            mutex.unlock();
+            continue;
+        }
+        if (rmsg[i].msg_hdr.msg_flags & MSG_TRUNC)
+        {
+            error("%s: Datagram longer than %" PRINTF_SIZE_T_PREFIX
+                "u bytes truncated\n",
+                rport[i]->name, MaxDatagram);
+            mutex.lock();
+            truncated++;
+            mutex.unlock();
+        }
+        rport[i]->receive(rbuf + i * MaxDatagram, rmsg[i].msg_len);
+    }
+    mutex.lock();
+    dispatching = false;
+    flush();
+    mutex.unlock();
+}
+
+void UdpSocket::
+printStatus(StreamBuffer& buffer)
+{
+    mutex.lock();
+    buffer.print("socket batches=%lu datagrams=%lu unknown=%lu"
+        " truncated=%lu sendbatches=%lu sent=%lu dropped=%lu ",
+        batches, received, unknown, truncated, sendBatches, sent, dropped);
+    mutex.unlock();
+}
+
+UdpPort::
+UdpPort(const char* name, const char* hostInfo, UdpSocket* socket,
+    const struct sockaddr* _address, socklen_t _addresslen) :
+    StreamFdPort("udp", name, hostInfo, socket->eventLoop()),
+    socket(socket)
+{
+    datagrams = true;
+    nextPeer = NULL;
+    memcpy(&address, _address, _addresslen);
+    addresslen = _addresslen;
+    socket->addPeer(this);
+}
+
+long UdpPort::
+configure(const char* name, const char* hostInfo, int localport)
+{
+    char host[256];
+    const char* hostname = hostInfo;
+    const char* service;
+    struct addrinfo hints;
+    struct addrinfo* result;
+    size_t len;
+    int status;
+
+    if (!name || !hostInfo)
+    {
+        fprintf(stderr, "Usage: streamUdpConfigure \"portname\", "
+            "\"host:port\", [localport]\n");
+        return -1;
+    }
+    if (find(name))
+    {
+        fprintf(stderr, "streamUdpConfigure: port %s already exists\n",
+            name);
+        return -1;
+    }
+    if (localport < 0 || localport > 65535)
+    {
+        fprintf(stderr, "streamUdpConfigure: invalid local port %d\n",
+            localport);
+        return -1;
+    }
+    // host:port or [ipv6]:port, anything after a space is ignored
+    service = strrchr(hostInfo, ':');
+    if (!service || service == hostInfo)
+    {
+        fprintf(stderr, "streamUdpConfigure: %s: expect \"host:port\"\n",
+            hostInfo);
+        return -1;
+    }
+    len = service - hostInfo;
+    if (hostInfo[0] == '[' && service[-1] == ']')
+    {
+        hostname++;
+        len -= 2;
+    }
+    if (len >= sizeof(host)) len = sizeof(host) - 1;
+    memcpy(host, hostname, len);
+    host[len] = 0;
+    service++;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    status = getaddrinfo(host, StreamBuffer(service, strcspn(service, " "))(),
+        &hints, &result);
+    if (status != 0)
+    {
+        fprintf(stderr, "streamUdpConfigure: %s: %s\n",
+            host, gai_strerror(status));
+        return -1;
+    }
+    UdpSocket* socket = UdpSocket::get(result->ai_family, localport);
+    if (!socket)
+    {
+        freeaddrinfo(result);
+        return -1;
+    }
+    UdpPort* port = new UdpPort(name, hostInfo, socket, result->ai_addr,
+        result->ai_addrlen);
+    freeaddrinfo(result);
+    port->start();
+    return 0;
+}
+
+// Nothing to connect.
+void UdpPort::
+open()
+{
+    opened();
+}
+
+ssize_t UdpPort::
+writeBytes(const void* output, size_t size)
+{
+    return socket->send((struct sockaddr*)&address, addresslen,
+        output, size);
+}
+
+// Called by the socket in the loop thread.
+void UdpPort::
+receive(const char* data, size_t size)
+{
+    mutex.lock();
+    if (state == Connected)
+    {
+        chunk.set(data, size);
+        received();
+    }
+    mutex.unlock();
+}
+
+void UdpPort::
+printStatus(StreamBuffer& buffer)
+{
+    socket->printStatus(buffer);
+}
+
+StreamBusInterface* UdpInterface::
+getBusInterface(Client* client,
+    const char* busname, int addr, const char*)
+{
+    StreamFdPort* port = findPort(busname, addr, "udp");
+    if (!port) return NULL;
+    UdpInterface* interface = new UdpInterface(client, port);
+    debug ("UdpInterface::getBusInterface(%s, %d): "
+        "new interface allocated\n",
+        busname, addr);
+    return interface;
+}
+
+extern "C" long streamUdpConfigure(const char* portname,
+    const char* hostInfo, int localport)
+{
+    return UdpPort::configure(portname, hostInfo, localport);
+}
+
+#else
+
+// No epoll on this system. Records cannot find any port.
+void* ref_UdpInterface = NULL;
+
+extern "C" long streamUdpConfigure(const char*, const char*, int)
+{
+    fprintf(stderr, "streamUdpConfigure: not supported on this system\n");
+    return -1;
+}
+
+#endif
+
+static const iocshArg streamUdpConfigureArg0 =
+    { "portname", iocshArgString };
+static const iocshArg streamUdpConfigureArg1 =
+    { "host:port", iocshArgString };
+static const iocshArg streamUdpConfigureArg2 =
+    { "localport", iocshArgInt };
+static const iocshArg * const streamUdpConfigureArgs[] =
+    { &streamUdpConfigureArg0, &streamUdpConfigureArg1,
+      &streamUdpConfigureArg2 };
+static const iocshFuncDef streamUdpConfigureDef =
+    { "streamUdpConfigure", 3, streamUdpConfigureArgs };
+
+void streamUdpConfigureFunc(const iocshArgBuf *args)
+{
+    streamUdpConfigure(args[0].sval, args[1].sval, args[2].ival);
+}
+
+static void UdpInterfaceRegistrar ()
+{
+     iocshRegister(&streamUdpConfigureDef, streamUdpConfigureFunc);
+}
+
+extern "C" {
+epicsExportRegistrar(UdpInterfaceRegistrar);
+}
@@ -110,8 +110,12 @@ long streamReadWrite(dbCommon *record);
 long streamGetIointInfo(int cmd,
     dbCommon *record, IOSCANPVT *ppvt);
 long streamPrintf(dbCommon *record, format_t *format, ...);
+long streamPrintArray(dbCommon *record, format_t *format,
+    const void* buffer, unsigned short type, size_t nelm);
 ssize_t streamScanfN(dbCommon *record, format_t *format,
     void*, size_t maxStringSize);
+ssize_t streamScanArray(dbCommon *record, format_t *format,
+    void* buffer, unsigned short type, size_t nelm);
 
 #ifdef __cplusplus
 }
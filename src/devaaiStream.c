@@ -26,272 +26,54 @@
 static long readData(dbCommon *record, format_t *format)
 {
     aaiRecord *aai = (aaiRecord *)record;
-    double dval;
-    long lval;
+    ssize_t length;
 
-    for (aai->nord = 0; aai->nord < aai->nelm; aai->nord++)
+    aai->nord = 0;
+    if (format->type == DBF_STRING &&
+        (aai->ftvl == DBF_CHAR || aai->ftvl == DBF_UCHAR))
     {
-        switch (format->type)
+        /* string to char array */
+        if ((length = streamScanfN(record, format,
+            (char *)aai->bptr, aai->nelm)) == ERROR)
         {
-            case DBF_DOUBLE:
-            {
-                if (streamScanf(record, format, &dval) == ERROR)
-                {
-                    return aai->nord ? OK : ERROR;
-                }
-                switch (aai->ftvl)
-                {
-                    case DBF_DOUBLE:
-                        ((epicsFloat64 *)aai->bptr)[aai->nord] = (epicsFloat64)dval;
-                        break;
-                    case DBF_FLOAT:
-                        ((epicsFloat32 *)aai->bptr)[aai->nord] = (epicsFloat32)dval;
-                        break;
-                    default:
-                        errlogSevPrintf(errlogFatal,
-                            "readData %s: can't convert from double to %s\n",
-                            record->name, pamapdbfType[aai->ftvl].strvalue);
-                        return ERROR;
-                }
-                break;
-            }
-            case DBF_ULONG:
-            case DBF_LONG:
-            case DBF_ENUM:
-            {
-                if (streamScanf(record, format, &lval) == ERROR)
-                {
-                    return aai->nord ? OK : ERROR;
-                }
-                switch (aai->ftvl)
-                {
-                    case DBF_DOUBLE:
-                        ((epicsFloat64 *)aai->bptr)[aai->nord] = (epicsFloat64)lval;
-                        break;
-                    case DBF_FLOAT:
-                        ((epicsFloat32 *)aai->bptr)[aai->nord] = (epicsFloat32)lval;
-                        break;
-#ifdef DBR_INT64
-                    case DBF_INT64:
-                    case DBF_UINT64:
-                        ((epicsInt64 *)aai->bptr)[aai->nord] = (epicsInt64)lval;
-                        break;
-#endif
-                    case DBF_LONG:
-                    case DBF_ULONG:
-                        ((epicsInt32 *)aai->bptr)[aai->nord] = (epicsInt32)lval;
-                        break;
-                    case DBF_SHORT:
-                    case DBF_USHORT:
-                    case DBF_ENUM:
-                        ((epicsInt16 *)aai->bptr)[aai->nord] = (epicsInt16)lval;
-                        break;
-                    case DBF_CHAR:
-                    case DBF_UCHAR:
-                        ((epicsInt8 *)aai->bptr)[aai->nord] = (epicsInt8)lval;
-                        break;
-                    default:
-                        errlogSevPrintf(errlogFatal,
-                            "readData %s: can't convert from long to %s\n",
-                            record->name, pamapdbfType[aai->ftvl].strvalue);
-                        return ERROR;
-                }
-                break;
-            }
-            case DBF_STRING:
-            {
-                switch (aai->ftvl)
-                {
-                    case DBF_STRING:
-                        if (streamScanfN(record, format,
-                            (char *)aai->bptr + aai->nord * MAX_STRING_SIZE,
-                            MAX_STRING_SIZE) == ERROR)
-                        {
-                            return aai->nord ? OK : ERROR;
-                        }
-                        break;
-                    case DBF_CHAR:
-                    case DBF_UCHAR:
-                    {
-                        ssize_t length;
-                        aai->nord = 0;
-                        if ((length = streamScanfN(record, format,
-                            (char *)aai->bptr, aai->nelm)) == ERROR)
-                        {
-                            return ERROR;
-                        }
-                        if (length < (ssize_t)aai->nelm)
-                        {
-                            ((char*)aai->bptr)[length] = 0;
-                        }
-                        aai->nord = (long)length;
-                        return OK;
-                    }
-                    default:
-                        errlogSevPrintf(errlogFatal,
-                            "readData %s: can't convert from string to %s\n",
-                            record->name, pamapdbfType[aai->ftvl].strvalue);
-                        return ERROR;
-                }
-                break;
-            }
-            default:
-            {
-                errlogSevPrintf(errlogMajor,
-                    "readData %s: can't convert from %s to %s\n",
-                    record->name, pamapdbfType[format->type].strvalue,
-                    pamapdbfType[aai->ftvl].strvalue);
-                return ERROR;
-            }
+            return ERROR;
         }
+        if (length < (ssize_t)aai->nelm)
+        {
+            ((char*)aai->bptr)[length] = 0;
+        }
+        aai->nord = (long)length;
+        return OK;
+    }
+    if ((length = streamScanArray(record, format,
+        aai->bptr, aai->ftvl, aai->nelm)) == ERROR)
+    {
+        return ERROR;
     }
+    aai->nord = (long)length;
     return OK;
 }
 
 static long writeData(dbCommon *record, format_t *format)
 {
     aaiRecord *aai = (aaiRecord *)record;
-    double dval;
-    long lval;
-    unsigned long nowd;
 
-    for (nowd = 0; nowd < aai->nord; nowd++)
+    if (aai->nord == 0) return OK;
+    if (format->type == DBF_STRING &&
+        (aai->ftvl == DBF_CHAR || aai->ftvl == DBF_UCHAR))
     {
-        switch (format->type)
+        /* print waveform as a null-terminated string */
+        if (aai->nord < aai->nelm)
+        {
+            ((char *)aai->bptr)[aai->nord] = 0;
+        }
+        else
         {
-            case DBF_DOUBLE:
-            {
-                switch (aai->ftvl)
-                {
-                    case DBF_DOUBLE:
-                        dval = ((epicsFloat64 *)aai->bptr)[nowd];
-                        break;
-                    case DBF_FLOAT:
-                        dval = ((epicsFloat32 *)aai->bptr)[nowd];
-                        break;
-#ifdef DBR_INT64
-                    case DBF_INT64:
-                        dval = (double)((epicsInt64 *)aai->bptr)[nowd];
-                        break;
-                    case DBF_UINT64:
-                        dval = (double)((epicsUInt64 *)aai->bptr)[nowd];
-                        break;
-#endif
-                    case DBF_LONG:
-                        dval = ((epicsInt32 *)aai->bptr)[nowd];
-                        break;
-                    case DBF_ULONG:
-                        dval = ((epicsUInt32 *)aai->bptr)[nowd];
-                        break;
-                    case DBF_SHORT:
-                    case DBF_ENUM:
-                        dval = ((epicsInt16 *)aai->bptr)[nowd];
-                        break;
-                    case DBF_USHORT:
-                        dval = ((epicsUInt16 *)aai->bptr)[nowd];
-                        break;
-                    case DBF_CHAR:
-                        dval = ((epicsInt8 *)aai->bptr)[nowd];
-                        break;
-                    case DBF_UCHAR:
-                        dval = ((epicsUInt8 *)aai->bptr)[nowd];
-                        break;
-                    default:
-                        errlogSevPrintf(errlogFatal,
-                            "writeData %s: can't convert from %s to double\n",
-                            record->name, pamapdbfType[aai->ftvl].strvalue);
-                        return ERROR;
-                }
-                if (streamPrintf(record, format, dval))
-                    return ERROR;
-                break;
-            }
-            case DBF_ULONG:
-            case DBF_LONG:
-            case DBF_ENUM:
-            {
-                switch (aai->ftvl)
-                {
-#ifdef DBR_INT64
-                    case DBF_INT64:
-                        lval = (long)((epicsInt64 *)aai->bptr)[nowd];
-                        break;
-                    case DBF_UINT64:
-                        lval = (long)((epicsUInt64 *)aai->bptr)[nowd];
-                        break;
-#endif
-                    case DBF_LONG:
-                        lval = ((epicsInt32 *)aai->bptr)[nowd];
-                        break;
-                    case DBF_ULONG:
-                        lval = ((epicsUInt32 *)aai->bptr)[nowd];
-                        break;
-                    case DBF_SHORT:
-                    case DBF_ENUM:
-                        lval = ((epicsInt16 *)aai->bptr)[nowd];
-                        break;
-                    case DBF_USHORT:
-                        lval = ((epicsUInt16 *)aai->bptr)[nowd];
-                        break;
-                    case DBF_CHAR:
-                        lval = ((epicsInt8 *)aai->bptr)[nowd];
-                        break;
-                    case DBF_UCHAR:
-                        lval = ((epicsUInt8 *)aai->bptr)[nowd];
-                        break;
-                    default:
-                        errlogSevPrintf(errlogFatal,
-                            "writeData %s: can't convert from %s to long\n",
-                            record->name, pamapdbfType[aai->ftvl].strvalue);
-                        return ERROR;
-                }
-                if (streamPrintf(record, format, lval))
-                    return ERROR;
-                break;
-            }
-            case DBF_STRING:
-            {
-                switch (aai->ftvl)
-                {
-                    case DBF_STRING:
-                        if (streamPrintf(record, format,
-                            ((char *)aai->bptr) + nowd * MAX_STRING_SIZE))
-                            return ERROR;
-                        break;
-                    case DBF_CHAR:
-                    case DBF_UCHAR:
-                        /* print aai as a null-terminated string */
-                        if (aai->nord < aai->nelm)
-                        {
-                            ((char *)aai->bptr)[aai->nord] = 0;
-                        }
-                        else
-                        {
-                            ((char *)aai->bptr)[aai->nelm-1] = 0;
-                        }
-                        if (streamPrintf(record, format,
-                            ((char *)aai->bptr)))
-                            return ERROR;
-                        return OK;
-                    default:
-                        errlogSevPrintf(errlogFatal,
-                            "writeData %s: can't convert from %s to string\n",
-                            record->name, pamapdbfType[aai->ftvl].strvalue);
-                        return ERROR;
-                }
-                break;
-            }
-            default:
-            {
-                errlogSevPrintf(errlogFatal,
-                    "writeData %s: can't convert from %s to %s\n",
-                    record->name, pamapdbfType[aai->ftvl].strvalue,
-                    pamapdbfType[format->type].strvalue);
-                return ERROR;
-            }
+            ((char *)aai->bptr)[aai->nelm-1] = 0;
         }
+        return streamPrintf(record, format, ((char *)aai->bptr));
     }
-    return OK;
+    return streamPrintArray(record, format, aai->bptr, aai->ftvl, aai->nord);
 }
 
 static long initRecord(dbCommon *record)
@@ -23,17 +23,39 @@
 if (@ARGV[0] eq "--rec-only") {
     shift;
 } else {
-if (@ARGV[0] eq "--with-asyn") {
+while (@ARGV[0] =~ /^--with-(.*)/) {
     shift;
-    $asyn = 1;
+    $with{$1} = 1;
 }
 if (@ARGV[0] eq "-3.13") {
     shift;
 } else {
     print "variable(streamDebug, int)\n";
     print "variable(streamError, int)\n";
+    print "variable(streamParallelInit, int)\n";
     print "registrar(streamRegistrar)\n";
-    if ($asyn) { print "registrar(AsynDriverInterfaceRegistrar)\n"; }
+    if ($with{asyn}) {
+        print "registrar(AsynDriverInterfaceRegistrar)\n";
+        print "variable(streamCombineRequests, int)\n";
+        print "variable(streamEosCache, int)\n";
+        print "variable(streamFlushInput, int)\n";
+    }
+    if ($with{tcp}) {
+        print "registrar(TcpInterfaceRegistrar)\n";
+    }
+    if ($with{serial}) {
+        print "registrar(SerialInterfaceRegistrar)\n";
+    }
+    if ($with{udp}) {
+        print "registrar(UdpInterfaceRegistrar)\n";
+    }
+    if ($with{sim}) {
+        print "registrar(SimInterfaceRegistrar)\n";
+    }
+    if ($with{tcp} || $with{serial} || $with{udp} || $with{sim}) {
+        print "variable(streamEventLoopThreads, int)\n";
+        print "variable(streamIoUring, int)\n";
+    }
 }
 print "driver(stream)\n";
 }